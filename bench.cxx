@@ -0,0 +1,416 @@
+/*******************************************************************************
+ * program: zsdatab-bench
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *******************************************************************************
+ * Copyright (C) 2021 zseri
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *******************************************************************************/
+
+#include "zsdatable.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+  struct config {
+    vector<size_t> rows{10000, 100000}, widths{8, 64};
+    size_t cols = 6, repeat = 3;
+    unsigned long seed = 1;
+    set<string> only;
+    string dir;
+    bool hw = false;
+
+    bool selected(const string &name) const
+      { return only.empty() || only.count(name); }
+  };
+
+  /* dataset - a generated table
+   * c0 = key (rows / 100 distinct values), the other columns are random strings
+   * of about width characters; dim = 16 rows keyed by c0 for inner_join
+   */
+  struct dataset {
+    size_t rows, width, keys;
+    zsdatab::metadata meta;
+    zsdatab::table tab, dim;
+    string text, key, part;
+
+    static auto make_meta(const size_t cols) -> zsdatab::metadata {
+      zsdatab::row_t ret;
+      for(size_t i = 0; i < cols; ++i)
+        ret.emplace_back('c' + to_string(i));
+      return zsdatab::metadata(':', move(ret));
+    }
+
+    static auto make_rows(const config &cfg, const size_t n, const size_t w, const size_t keys) -> zsdatab::buffer_t {
+      mt19937_64 rng(cfg.seed ^ (n * 31 + w));
+      uniform_int_distribution<size_t> len(max<size_t>(1, w / 2), w + w / 2);
+      uniform_int_distribution<int> chr('a', 'z');
+
+      zsdatab::buffer_t ret;
+      ret.reserve(n);
+      for(size_t r = 0; r < n; ++r) {
+        zsdatab::row_t row;
+        row.reserve(cfg.cols);
+        row.emplace_back('k' + to_string(rng() % keys));
+        for(size_t c = 1; c < cfg.cols; ++c) {
+          string v(len(rng), '\0');
+          for(auto &i : v) i = chr(rng);
+          row.emplace_back(move(v));
+        }
+        ret.emplace_back(move(row));
+      }
+      return ret;
+    }
+
+    static auto make_dim(const size_t keys) -> zsdatab::buffer_t {
+      zsdatab::buffer_t ret;
+      for(size_t i = 0; i < 16; ++i)
+        ret.push_back({'k' + to_string(i % keys), 'd' + to_string(i)});
+      return ret;
+    }
+
+    dataset(const config &cfg, const size_t n, const size_t w)
+      : rows(n), width(w), keys(max<size_t>(1, n / 100)), meta(make_meta(cfg.cols)),
+        tab(meta, make_rows(cfg, n, w, keys)), dim(zsdatab::metadata(':', {"c0", "d1"}), make_dim(keys)),
+        key('k' + to_string(keys / 2)), part("ab")
+    {
+      ostringstream out;
+      out << tab;
+      text = out.str();
+    }
+  };
+
+  // outcome - result of one run (rows = output rows, bytes = processed bytes)
+  struct outcome {
+    size_t rows, bytes;
+  };
+
+  class runner {
+    const config &_cfg;
+    const dataset &_ds;
+
+    static double median(vector<double> v) {
+      sort(v.begin(), v.end());
+      const size_t n = v.size();
+      return (n % 2) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+    }
+
+   public:
+    runner(const config &cfg, const dataset &ds)
+      : _cfg(cfg), _ds(ds) { }
+
+    /* bench - setup() isn't timed, its result is passed to fn
+     * one JSON object per line
+     */
+    template<class Setup, class Fn>
+    void operator()(const string &name, const Setup &setup, const Fn &fn) const {
+      if(!_cfg.selected(name)) return;
+      vector<double> ns;
+      outcome res{0, 0};
+      zsdatab::hw_counters hw;
+      for(size_t r = 0; r < _cfg.repeat; ++r) {
+        auto st = setup();
+        // the counters are read outside of the timed part
+        const auto hw_start = _cfg.hw ? zsdatab::read_hw_counters() : zsdatab::hw_counters();
+        const auto start = chrono::steady_clock::now();
+        res = fn(st);
+        ns.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+        if(_cfg.hw) {
+          const auto hw_end = zsdatab::read_hw_counters();
+          const auto add = [](uint64_t &sum, const uint64_t a, const uint64_t b) { if(b > a) sum += b - a; };
+          add(hw.cycles, hw_start.cycles, hw_end.cycles);
+          add(hw.instructions, hw_start.instructions, hw_end.instructions);
+          add(hw.cache_misses, hw_start.cache_misses, hw_end.cache_misses);
+          add(hw.branch_misses, hw_start.branch_misses, hw_end.branch_misses);
+        }
+      }
+
+      const double med = median(ns);
+      char tmp[768];
+      int n = snprintf(tmp, sizeof(tmp),
+        "{\"bench\":\"%s\",\"rows\":%zu,\"cols\":%zu,\"width\":%zu,\"threads\":%zu,\"repeat\":%zu,"
+        "\"min_ns\":%.0f,\"median_ns\":%.0f,\"max_ns\":%.0f,\"rows_out\":%zu,\"bytes\":%zu,"
+        "\"rows_per_s\":%.0f,\"mb_per_s\":%.2f",
+        name.c_str(), _ds.rows, _ds.meta.get_field_count(), _ds.width, zsdatab::get_thread_count(), ns.size(),
+        *min_element(ns.begin(), ns.end()), med, *max_element(ns.begin(), ns.end()), res.rows, res.bytes,
+        med ? (_ds.rows * 1e9 / med) : 0.0, med ? (res.bytes * 1e3 / med) : 0.0);
+      // hardware counters: average per run
+      if(_cfg.hw) {
+        const double runs = ns.size();
+        n += snprintf(tmp + n, sizeof(tmp) - n,
+          ",\"cycles\":%.0f,\"instructions\":%.0f,\"cache_misses\":%.0f,\"branch_misses\":%.0f",
+          hw.cycles / runs, hw.instructions / runs, hw.cache_misses / runs, hw.branch_misses / runs);
+      }
+      snprintf(tmp + n, sizeof(tmp) - n, "}\n");
+      cout << tmp << flush;
+    }
+  };
+
+  // table files of the load/store benchmarks
+  enum class file_kind { plain, packed, gzipped };
+
+  bool create_file(const string &path, const zsdatab::metadata &meta, const file_kind k) {
+    switch(k) {
+      case file_kind::plain: {
+        ofstream m(path + ".meta");
+        m << meta;
+        ofstream d(path);
+        return m.good() && d.good();
+      }
+      case file_kind::packed:  return zsdatab::create_packed_table(path, meta);
+      case file_kind::gzipped: return zsdatab::create_gzipped_table(path, meta);
+    }
+    return false;
+  }
+
+  auto open_file(const string &path, const file_kind k) -> zsdatab::table {
+    switch(k) {
+      case file_kind::packed:  return zsdatab::make_packed_table(path);
+      case file_kind::gzipped: return zsdatab::make_gzipped_table(path);
+      default:                 return zsdatab::table(path);
+    }
+  }
+
+  void remove_file(const string &path) {
+    unlink(path.c_str());
+    unlink((path + ".meta").c_str());
+  }
+
+  void run_dataset(const config &cfg, dataset &ds) {
+    const runner bench(cfg, ds);
+    const auto none = [] { return 0; };
+    const auto ctx = [&ds] { return zsdatab::context(ds.tab); };
+    const auto count = [](const zsdatab::intern::context_common &c) { return outcome{c.count(), 0}; };
+
+    // parse/serialize (in memory)
+    bench("parse", [&ds] { return zsdatab::table(ds.meta); }, [&ds](zsdatab::table &t) {
+      t.import_rows(ds.text);
+      return outcome{t.rows().size(), ds.text.size()};
+    });
+    bench("serialize", none, [&ds](int) {
+      ostringstream out;
+      out << ds.tab;
+      return outcome{ds.rows, out.str().size()};
+    });
+
+    // load/store
+    static const pair<const char *, file_kind> kinds[] = {
+      {"plain", file_kind::plain}, {"packed", file_kind::packed}, {"gzipped", file_kind::gzipped}
+    };
+    for(const auto &k : kinds) {
+      const string path = cfg.dir + "/table-" + k.first;
+      const string store = string("store_") + k.first, load = string("load_") + k.first;
+      if(!cfg.selected(store) && !cfg.selected(load)) continue;
+
+      // a fresh table with all rows (store is timed without the empty load)
+      const auto fresh = [&] {
+        remove_file(path);
+        if(!create_file(path, ds.meta, k.second)) {
+          cerr << "zsdatab-bench: ERROR: " << path << ": create failed\n";
+          exit(1);
+        }
+        auto t = open_file(path, k.second);
+        t.shared_rows(ds.tab.shared_rows());
+        return t;
+      };
+      bench(store, fresh, [](zsdatab::table &t) {
+        t.sync();
+        return outcome{t.rows().size(), t.get_io_stats().bytes_written};
+      });
+
+      if(!cfg.selected(store)) fresh().sync();
+      bench(load, none, [&](int) {
+        const auto t = open_file(path, k.second);
+        return outcome{t.rows().size(), t.get_io_stats().bytes_read};
+      });
+      remove_file(path);
+    }
+
+    // select
+    bench("filter_whole", ctx, [&ds, count](zsdatab::context &c) {
+      return count(c.filter("c0", ds.key, true));
+    });
+    bench("filter_part", ctx, [&ds, count](zsdatab::context &c) {
+      return count(c.filter("c1", ds.part, false));
+    });
+    bench("filter_neg", ctx, [&ds, count](zsdatab::context &c) {
+      return count(c.filter("c0", ds.key, true, true));
+    });
+    bench("sort", ctx, [count](zsdatab::context &c) {
+      return count(c.sort({{"c1", zsdatab::asc}}));
+    });
+    bench("uniq", ctx, [count](zsdatab::context &c) {
+      return count(c.uniq());
+    });
+    bench("negate", [&] {
+      auto c = ctx();
+      c.filter("c0", ds.key, true);
+      return c;
+    }, [count](zsdatab::context &c) {
+      return count(c.negate());
+    });
+    bench("inner_join", none, [&ds](int) {
+      const auto t = zsdatab::inner_join(':', ds.tab, ds.dim);
+      return outcome{t.rows().size(), 0};
+    });
+
+    // change
+    bench("fixcol_replace", ctx, [count](zsdatab::context &c) {
+      return count(c.replace_part("c1", "a", "xy"));
+    });
+    bench("transaction", [&] {
+      zsdatab::transaction ta(ds.meta);
+      ta.filter(zsdatab::predicate::parse("c0 = " + ds.key + " or c2 ~ " + ds.part))
+        .set_field("c3", "done")
+        .sort({{"c1", zsdatab::asc}});
+      return make_pair(ctx(), move(ta));
+    }, [count](pair<zsdatab::context, zsdatab::transaction> &st) {
+      st.second.apply(st.first);
+      return count(st.first);
+    });
+
+    // macro: what a zsdatab-entry call does (load, filter, change, push, write back)
+    if(cfg.selected("entry_plain")) {
+      const string path = cfg.dir + "/table-entry";
+      remove_file(path);
+      create_file(path, ds.meta, file_kind::plain);
+      {
+        auto t = open_file(path, file_kind::plain);
+        t.shared_rows(ds.tab.shared_rows());
+      }
+      // every run changes the rows, so every run writes the table back
+      size_t run = 0;
+      bench("entry_plain", none, [&](int) {
+        auto t = open_file(path, file_kind::plain);
+        zsdatab::context c(t);
+        c.filter("c0", ds.key, true);
+        c.update({{zsdatab::mut_op::set, "c2", "changed" + to_string(run++), {}}});
+        t.sync();
+        return outcome{c.count(), t.get_io_stats().bytes_written};
+      });
+      remove_file(path);
+    }
+  }
+
+  const set<string> bench_names{
+    "parse", "serialize", "store_plain", "load_plain", "store_packed", "load_packed", "store_gzipped", "load_gzipped",
+    "filter_whole", "filter_part", "filter_neg", "sort", "uniq", "negate", "inner_join", "fixcol_replace", "transaction",
+    "entry_plain"
+  };
+
+  bool parse_list(const char *arg, vector<size_t> &ret) {
+    ret.clear();
+    istringstream in(arg);
+    string tmp;
+    while(getline(in, tmp, ',')) {
+      if(tmp.empty() || !all_of(tmp.begin(), tmp.end(), ::isdigit)) return false;
+      ret.push_back(stoul(tmp));
+    }
+    return !ret.empty();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  config cfg;
+  bool ok = true;
+  int opt;
+  while(ok && (opt = getopt(argc, argv, "n:w:c:r:s:b:d:H")) != -1) {
+    vector<size_t> tmp;
+    switch(opt) {
+      case 'n': ok = parse_list(optarg, cfg.rows); break;
+      case 'w': ok = parse_list(optarg, cfg.widths); break;
+      case 'c': ok = parse_list(optarg, tmp) && tmp.size() == 1 && tmp[0]; if(ok) cfg.cols = max<size_t>(tmp[0], 4); break;
+      case 'r': ok = parse_list(optarg, tmp) && tmp.size() == 1 && tmp[0]; if(ok) cfg.repeat = tmp[0]; break;
+      case 's': cfg.seed = strtoul(optarg, nullptr, 10); break;
+      case 'b': {
+        istringstream in(optarg);
+        string name;
+        while(ok && getline(in, name, ',')) {
+          ok = bench_names.count(name);
+          if(!ok) cerr << "zsdatab-bench: ERROR: unknown benchmark '" << name << "'\n";
+          cfg.only.insert(name);
+        }
+        break;
+      }
+      case 'd': cfg.dir = optarg; break;
+      case 'H': cfg.hw = true; break;
+      default: ok = false;
+    }
+  }
+
+  if(!ok || optind != argc) {
+    cerr << "USAGE: zsdatab-bench [-n ROWS,...] [-w WIDTH,...] [-c COLS] [-r REPEAT] [-s SEED] [-b BENCH,...] [-d DIR] [-H]\n"
+            "\n"
+            "Runs every benchmark for every table size (default: 10000,100000 rows) and\n"
+            "value width (default: 8,64 characters) and prints one JSON object per line\n"
+            "\n"
+            "Options:\n"
+            "  -c COLS       column count (at least 4, default: 6)\n"
+            "  -r REPEAT     runs per benchmark (default: 3)\n"
+            "  -s SEED       seed of the generated tables (default: 1)\n"
+            "  -b BENCH,...  run only these benchmarks\n"
+            "  -d DIR        directory of the table files (default: a new directory in $TMPDIR or /tmp)\n"
+            "  -H            add the hardware counters (cycles, instructions, cache and branch misses\n"
+            "                per run) of this process, if available\n"
+            "\n"
+            "Benchmarks:\n"
+            "  parse serialize store_plain load_plain store_packed load_packed store_gzipped load_gzipped\n"
+            "  filter_whole filter_part filter_neg sort uniq negate inner_join fixcol_replace transaction\n"
+            "  entry_plain\n"
+            "\n"
+            "zsdatab v0.3.1 by zseri <zseri.devel@ytrizja.de>\n"
+            "released under LGPL-2.1-or-later\n";
+    return 1;
+  }
+
+  if(cfg.hw && !zsdatab::enable_hw_counters()) {
+    cerr << "zsdatab-bench: WARNING: hardware counters unavailable\n";
+    cfg.hw = false;
+  }
+
+  bool own_dir = false;
+  if(cfg.dir.empty()) {
+    const char *tmpdir = getenv("TMPDIR");
+    string tmpl = string((tmpdir && *tmpdir) ? tmpdir : "/tmp") + "/zsdatab-bench.XXXXXX";
+    if(!mkdtemp(tmpl.data())) {
+      perror("zsdatab-bench: mkdtemp");
+      return 1;
+    }
+    cfg.dir = tmpl;
+    own_dir = true;
+  }
+
+  for(const auto n : cfg.rows)
+    for(const auto w : cfg.widths) {
+      dataset ds(cfg, n, w);
+      run_dataset(cfg, ds);
+    }
+
+  if(own_dir) rmdir(cfg.dir.c_str());
+  return 0;
+}
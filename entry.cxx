@@ -20,185 +20,261 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  *******************************************************************************/
 
-#include "zsdatable.hpp"
+#include "entry_common.hpp"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <zlib.h>
 
-#include <ctype.h>
 #include <iostream>
+#include <iterator>
 #include <fstream>
-#include <algorithm>
-#include <deque>
+#include <sstream>
 
 using namespace std;
+using namespace zsdatab_entry;
+
+// reads_stdin - check if the command list imports from stdin
+template<class T>
+static bool reads_stdin(const T &words) {
+  for(size_t i = 0; i + 2 < words.size(); ++i)
+    if((words[i] == "import" || words[i] == "merge") && words[i + 2] == "-")
+      return true;
+  return false;
+}
+
+// read_metadata - read the metadata of a table without locking or loading it
+static bool read_metadata(const string &name, const bool gzipped, zsdatab::metadata &meta) {
+  if(!gzipped) {
+    ifstream in(name + ".meta");
+    in >> meta;
+  } else {
+    // the metadata lines are at the start of the file
+    const gzFile f = gzopen(name.c_str(), "rb");
+    if(!f) return false;
+    string head(0x10000, '\0');
+    const int n = gzread(f, head.data(), head.size());
+    gzclose(f);
+    if(n <= 0) return false;
+    head.resize(n);
+    istringstream in(head);
+    in >> meta;
+  }
+  return !meta.empty();
+}
 
-static string my_tolower(string instr) {
-  transform(instr.begin(), instr.end(), instr.begin(), ::tolower);
-  return instr;
+// connect_server - get a connection to a running zsdatab-server (or -1)
+static int connect_server() {
+  const string path = socket_path();
+  sockaddr_un addr = {};
+  if(path.empty() || path.size() >= sizeof(addr.sun_path)) return -1;
+  addr.sun_family = AF_UNIX;
+  path.copy(addr.sun_path, path.size());
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd < 0) return -1;
+  if(connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr))) {
+    close(fd);
+    return -1;
+  }
+  if(!same_user(fd)) {
+    cerr << "zsdatab-entry: WARNING: " << path << ": the server runs as another user, ignored\n";
+    close(fd);
+    return -1;
+  }
+  return fd;
 }
 
-static unsigned int xsel_gmatcht(const string &mat) {
-  if(mat == "whole" || mat == "=") return 1;
-  if(mat == "part"  || mat == "LIKE") return 2;
-  return 0;
+// run_on_server - send the request to the server and print its response
+static int run_on_server(const int fd, const vector<string> &req) {
+  vector<string> resp;
+  int code = 1;
+  if(!write_message(fd, req) || !read_message(fd, resp, 3, SIZE_MAX) || resp.size() != 3) {
+    cerr << "zsdatab-entry: ERROR: " << socket_path() << ": server communication failed\n";
+  } else {
+    cout << resp[1] << flush;
+    cerr << resp[2];
+    code = atoi(resp[0].c_str());
+  }
+  close(fd);
+  return code;
 }
 
 int main(int argc, char *argv[]) {
-  if(argc < 2) {
-    cerr << "USAGE: zsdatab-entry [-z] TABLE [CMD ARGS... ]...\n"
+  bool is_gzipped = false, local = false, profile = false, explain = false;
+  const char *script = nullptr;
+  int ai = 1;
+  for(; ai < argc; ++ai) {
+    const string opt = argv[ai];
+    if(opt == "-z") is_gzipped = true;
+    else if(opt == "-l") local = true;
+    else if(opt == "--profile") profile = true;
+    else if(opt == "--explain") explain = true;
+    else if(opt == "-f" && ai + 1 < argc) script = argv[++ai];
+    else break;
+  }
+
+  if(ai >= argc) {
+    cerr << "USAGE: zsdatab-entry [OPTIONS] TABLE [CMD ARGS... ]...\n"
+            "       zsdatab-entry [OPTIONS] -f SCRIPT TABLE\n"
             "\n"
             "Options:\n"
             "  -z                                  TABLE is gzipped and packed instead of plain\n"
+            "  -f SCRIPT                           run the commands in SCRIPT (- = stdin), one command list per line\n"
+            "  -l                                  don't use a running zsdatab-server\n"
+            "  --profile                           print rows in/out and wall/CPU time (and hardware counters,\n"
+            "                                      if available) of every command, of the table lock, load\n"
+            "                                      and write-back to stderr\n"
+            "  --explain                           print the planned operations instead of running them\n"
             "\n"
             "Commands:\n"
             "  select FIELD VALUE                  select all entries that match VALUE (deprecated)\n"
             "  xsel whole|part|LIKE|= FIELD VALUE  select all entries that match VALUE (whole field or partial)\n"
+            "  where EXPR                          select all entries that match the expression EXPR\n"
+            "                                      (e.g. 'a = x and (b ~ y or not c >= 5)')\n"
             "  neg                                 negate buffer\n"
             "  get FIELD                           get field FIELD and exit\n"
+            "  count-by FIELD                      print every value of FIELD with its entry count and exit\n"
+            "  count-distinct FIELD                print the number of distinct values of FIELD and exit\n"
+            "  count                               print the entry count and exit\n"
+            "  exists                              print true (exit 0) if there are entries, otherwise false (exit 1)\n"
+            "  limit COUNT                         keep only the first COUNT entries\n"
+            "  top FIELD asc|desc COUNT            keep the first COUNT entries ordered by FIELD\n"
             "\n"
             "  ch FIELD NEWVALUE                   change FIELD to NEWVALUE\n"
             "  rmpart FIELD SUBSTRING              remove FIELD-part SUBSTRING\n"
             "  appart FIELD SUBSTRING              append FIELD-part SUBSTRING\n"
             "\n"
             "  new COLUMNS...                      create new entry\n"
+            "  import native|tsv|csv FILE          append all rows in FILE (- = stdin)\n"
+            "  merge native|tsv|csv FILE KEYS      like import, but rows replace the row with the same\n"
+            "                                      KEYS (FIELD[,FIELD]...)\n"
             "  rm                                  remove selected entries (= negate push)\n"
             "  rmexcept                            remove everything except selected entries (= push)\n"
             "\n"
             "Other Commands:\n"
             "  quit                                quit without printing buffer\n"
-            "  push                                update table file\n"
+            "  push                                update table\n"
+            "  pull                                reset buffer to the whole table\n"
+            "  save NAME                           save buffer as NAME\n"
+            "  load NAME                           replace buffer with the saved buffer NAME\n"
+            "  print                               print buffer\n"
             "\n"
-            "Commands can be joined\n\n"
+            "Commands can be joined\n"
+            "In script mode, get and count-by don't exit, the buffer is only printed by print\n"
+            "and the table is written once at the end\n"
+            "If zsdatab-server is running (socket: $ZSDATAB_SOCKET, $XDG_RUNTIME_DIR/zsdatab.sock\n"
+            "or /tmp/zsdatab-UID.sock), the commands run there\n\n"
             "zsdatab v0.3.1 by zseri <zseri.devel@ytrizja.de>\n"
             "released under LGPL-2.1-or-later\n";
     return 1;
-  } else if(argc == 2 && string(argv[1]) != "-z") {
+  }
+
+  const char *const table_name = argv[ai++];
+  if(ai == argc && !is_gzipped && !script && !profile && !explain) {
     string tmp;
-    ifstream in(argv[1]);
+    ifstream in(table_name);
     if(!in) {
-      cerr << "zsdatab-entry: ERROR: " << argv[1] << ": file not found\n";
+      cerr << "zsdatab-entry: ERROR: " << table_name << ": file not found\n";
       return 1;
     }
     while(getline(in, tmp)) cout << tmp << "\n";
     return 0;
   }
 
-  const bool is_gzipped = (string(argv[1]) == "-z");
-  zsdatab::table my_table = is_gzipped ? zsdatab::make_gzipped_table(argv[2]) : zsdatab::table(argv[1]);
-  if(!my_table.good()) {
-    cerr << "zsdatab-entry: ERROR: " << argv[1] << ": file not found / read failed\n";
+  if(script && ai != argc) {
+    cerr << "zsdatab-entry: ERROR: -f SCRIPT doesn't take commands as arguments\n";
     return 1;
   }
-  const size_t colcnt = my_table.get_metadata().get_field_count();
-
-  zsdatab::context my_ctx(my_table);
-  deque<string> commands(argv + 2 + (is_gzipped ? 1 : 0), argv + argc);
-
-  string cmd, field;
-
-  // parse commands
-  try {
-    while(!commands.empty()) {
-      cmd = my_tolower(commands.front());
-      commands.pop_front();
-      string selector;
-
-      // check args
-      {
-        bool args_ok = true;
-        if(cmd == "ch" || cmd == "select" || cmd == "appart" || cmd == "rmpart") {
-          if(commands.size() < 2 || commands.front().empty()) args_ok = false;
-          else field = commands[0];
-          commands.pop_front();
-        } else if(cmd == "xsel") {
-          if(commands.size() < 3 || commands[0].empty() || commands[1].empty()) args_ok = false;
-          else if(!xsel_gmatcht(commands[0])) args_ok = false;
-          else field = commands[1];
-          selector = commands[0];
-          commands.pop_front();
-          commands.pop_front();
-        } else if(cmd == "new") {
-          if(commands.size() < colcnt) args_ok = false;
-        } else if(cmd == "get") {
-          if(commands.empty() || commands.front().empty()) args_ok = false;
-          else field = commands[0];
-          commands.pop_front();
-        } else if(cmd == "rm" || cmd == "rmexcept" || cmd == "neg" || cmd == "quit" || cmd == "push") {
-          // do nothing
-        } else {
-          cerr << "zsdatab-entry: ERROR: unknown command '" << cmd << "'\n";
-          return 1;
-        }
 
-        if(!args_ok) {
-          cerr << "zsdatab-entry: ERROR: command " << cmd << ": invalid args\n";
-          return 1;
+  ifstream script_file;
+  if(script && string(script) != "-") {
+    script_file.open(script);
+    if(!script_file) {
+      cerr << "zsdatab-entry: ERROR: " << script << ": file not found\n";
+      return 1;
+    }
+  }
+  istream &script_in = script_file.is_open() ? script_file : cin;
+  const string script_name = script_file.is_open() ? script : "stdin";
+
+  if(explain) {
+    // the commands run against an empty copy of the table (the args are checked), but aren't executed
+    zsdatab::metadata meta;
+    if(!read_metadata(table_name, is_gzipped, meta)) {
+      cerr << "zsdatab-entry: ERROR: " << table_name << ": file not found / read failed\n";
+      return 1;
+    }
+    zsdatab::table tmp(meta);
+    session s(tmp, script, cout, cerr);
+    s.explain = true;
+    if(script)
+      return run_script(s, script_in, script_name);
+    deque<string> commands(argv + ai, argv + argc);
+    return run_args(s, commands);
+  }
+
+  // client mode (the server needs the absolute path of the table)
+  char table_path[PATH_MAX], cwd[PATH_MAX];
+  if(!local && realpath(table_name, table_path) && getcwd(cwd, sizeof(cwd))) {
+    const int fd = connect_server();
+    if(fd != -1) {
+      string flags;
+      if(is_gzipped) flags += 'z';
+      if(profile) flags += 'p';
+      vector<string> req{proto_magic, script ? "script" : "args", flags, table_path, cwd, {}};
+      bool need_stdin = false;
+      if(script) {
+        req.emplace_back(script_name);
+        req.emplace_back(istreambuf_iterator<char>(script_in), istreambuf_iterator<char>());
+        if(script_file.is_open()) {
+          istringstream lines(req.back());
+          string line;
+          deque<string> words;
+          while(!need_stdin && getline(lines, line))
+            need_stdin = split_line(line, words) && reads_stdin(words);
         }
+      } else {
+        req.insert(req.end(), argv + ai, argv + argc);
+        need_stdin = reads_stdin(req);
       }
-
-      // command execution
-      if(cmd == "ch") {
-        zsdatab::context tmp_ctx = my_ctx;
-        tmp_ctx.negate();
-
-        my_ctx.set_field(field, commands[0]);
-        commands.pop_front();
-
-        tmp_ctx += my_ctx;
-        tmp_ctx.push();
-      } else if(cmd == "appart") {
-        zsdatab::context tmp_ctx = my_ctx;
-        tmp_ctx.negate();
-
-        my_ctx.append_part(field, commands[0]);
-        commands.pop_front();
-
-        tmp_ctx += my_ctx;
-        tmp_ctx.push();
-      } else if(cmd == "rmpart") {
-        zsdatab::context tmp_ctx = my_ctx;
-        tmp_ctx.negate();
-
-        my_ctx.remove_part(field, commands[0]);
-        commands.pop_front();
-
-        tmp_ctx += my_ctx;
-        tmp_ctx.push();
-      } else if(cmd == "select") {
-        my_ctx.filter(field, commands[0]);
-        commands.pop_front();
-      } else if(cmd == "xsel") {
-        my_ctx.filter(field, commands[0], xsel_gmatcht(selector) == 1);
-        commands.pop_front();
-      } else if(cmd == "new") {
-        const auto cbi = commands.begin();
-        const auto cei = cbi + colcnt;
-        const vector<string> line(cbi, cei);
-        commands.erase(cbi, cei);
-
-        my_ctx.pull();
-        my_ctx += line;
-        my_ctx.push();
-      } else if(cmd == "get") {
-        for(auto &&l : my_ctx.get_column_data(field))
-          cout << l << '\n';
-        return 0;
-      } else if(cmd == "rm") {
-        my_ctx.negate();
-        my_ctx.push();
-      } else if(cmd == "rmexcept")
-        my_ctx.push();
-      else if(cmd == "neg")
-        my_ctx.negate();
-      else if(cmd == "push")
-        my_ctx.push();
-      else if(cmd == "quit")
-        return 0;
+      if(need_stdin)
+        req[5] = '<' + string(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+      return run_on_server(fd, req);
     }
-  } catch(const out_of_range&e) {
-    cerr << "zsdatab-entry: ERROR: command " << cmd << ": unknown fieldname '" << field << "'\n";
+  }
+
+  // hardware counters are used if they are available
+  if(profile) zsdatab::enable_hw_counters();
+
+  // the table is locked and loaded once, and written back (if changed) on exit
+  zsdatab::table my_table = is_gzipped ? zsdatab::make_gzipped_table(table_name) : zsdatab::table(table_name);
+  if(!my_table.good()) {
+    cerr << "zsdatab-entry: ERROR: " << table_name << ": file not found / read failed\n";
     return 1;
   }
 
-  // print buffer
-  cout << my_ctx;
-  return 0;
+  // a script from stdin can't import from stdin
+  session s(my_table, script, cout, cerr, (script && !script_file.is_open()) ? nullptr : &cin);
+  s.profile = profile;
+  int ret;
+  if(script) {
+    ret = run_script(s, script_in, script_name);
+  } else {
+    deque<string> commands(argv + ai, argv + argc);
+    ret = run_args(s, commands);
+  }
+
+  if(profile) {
+    // write back now to measure it
+    const auto prev = my_table.get_io_stats();
+    if(!my_table.sync()) ret = 1;
+    cout << flush;
+    print_profile(s, prev, true);
+  }
+  return ret;
 }
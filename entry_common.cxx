@@ -0,0 +1,577 @@
+/*******************************************************************************
+ *    part: zsdatab-entry commands, client/server protocol
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *******************************************************************************/
+
+#include "entry_common.hpp"
+#include "stopwatch.hpp"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <optional>
+
+using namespace std;
+
+namespace zsdatab_entry {
+  static string my_tolower(string instr) {
+    transform(instr.begin(), instr.end(), instr.begin(), ::tolower);
+    return instr;
+  }
+
+  static unsigned int xsel_gmatcht(const string &mat) {
+    if(mat == "whole" || mat == "=") return 1;
+    if(mat == "part"  || mat == "LIKE") return 2;
+    return 0;
+  }
+
+  // parse_count - a count: digits only, in the range of size_t
+  static bool parse_count(const string &s, size_t &ret) {
+    if(s.empty() || !all_of(s.begin(), s.end(), ::isdigit)) return false;
+    errno = 0;
+    const unsigned long long v = strtoull(s.c_str(), nullptr, 10);
+    if(errno == ERANGE || v > SIZE_MAX) return false;
+    ret = v;
+    return true;
+  }
+
+  static bool import_format_of(const string &name, zsdatab::import_format &fmt) {
+    if(name == "native")   fmt = zsdatab::import_format::native;
+    else if(name == "tsv") fmt = zsdatab::import_format::tsv;
+    else if(name == "csv") fmt = zsdatab::import_format::csv;
+    else return false;
+    return true;
+  }
+
+  /* peek_limit - get the count of a following 'limit COUNT' command (or npos)
+   * a following 'exists' exits, so only the first match is needed (if exits is set)
+   */
+  static size_t peek_limit(const deque<string> &commands, const size_t at, const bool exits) {
+    if(exits && commands.size() > at && my_tolower(commands[at]) == "exists")
+      return 1;
+    size_t ret;
+    if(commands.size() < at + 2 || my_tolower(commands[at]) != "limit" || !parse_count(commands[at + 1], ret))
+      return string::npos;
+    return ret;
+  }
+
+  // step_recorder - collect the costs of one command (profile mode)
+  class step_recorder final {
+    session &_s;
+    const deque<string> &_commands;
+    const vector<string> _words;
+    const size_t _rows_in;
+    zsdatab::intern::stopwatch _sw;
+
+   public:
+    step_recorder(session &s, const deque<string> &commands)
+      : _s(s), _commands(commands), _words(commands.begin(), commands.end()), _rows_in(s.ctx.count())
+      { _sw.restart(); }
+
+    ~step_recorder() noexcept {
+      try {
+        step_stats st{_s.where, _rows_in, 0, {}};
+        _sw.lap(st.time);
+        st.rows_out = _s.ctx.count();
+        // the words consumed by the command
+        const size_t n = _words.size() - _commands.size();
+        for(size_t i = 0; i < n; ++i) {
+          if(i) st.command += ' ';
+          st.command += _words[i];
+        }
+        _s.steps.emplace_back(move(st));
+      } catch(...) { }
+    }
+  };
+
+  // pending_args - count of the args a command takes after the args check
+  static size_t pending_args(const string &cmd, const size_t colcnt) {
+    if(cmd == "new") return colcnt;
+    if(cmd == "import") return 2;
+    if(cmd == "merge") return 3;
+    if(cmd == "ch" || cmd == "appart" || cmd == "rmpart" || cmd == "select" || cmd == "xsel" || cmd == "where"
+       || cmd == "limit" || cmd == "top" || cmd == "save" || cmd == "load")
+      return 1;
+    return 0;
+  }
+
+  static bool exits(const string &cmd) {
+    return cmd == "get" || cmd == "count-by" || cmd == "count-distinct" || cmd == "count" || cmd == "exists";
+  }
+
+  // explain - describe a checked command (its args are the front of commands)
+  static string explain(const session &s, const string &cmd, const string &field, const string &selector,
+                        const deque<string> &commands)
+  {
+    string ret;
+    if(cmd == "select" || cmd == "xsel" || cmd == "where") {
+      if(cmd == "where")
+        ret = "filter: " + commands[0] + " (compiled predicate, one pass)";
+      else if(cmd == "select" || xsel_gmatcht(selector) == 1)
+        ret = "filter: " + field + " = '" + commands[0] + "' (whole field)";
+      else
+        ret = "filter: " + field + " contains '" + commands[0] + "' (substring search)";
+      const size_t lim = peek_limit(commands, 1, !s.batch);
+      if(lim != string::npos)
+        ret += ", stops after " + to_string(lim) + ((lim == 1) ? " match" : " matches");
+    } else if(cmd == "limit") {
+      ret = "limit: keep the first " + commands[0] + " entries";
+    } else if(cmd == "top") {
+      ret = "top: partial sort by " + field + ' ' + selector + ", keep " + commands[0] + " entries";
+    } else if(cmd == "ch") {
+      ret = "update in place: set " + field + " to '" + commands[0] + "' (changes the table)";
+    } else if(cmd == "appart") {
+      ret = "update in place: append '" + commands[0] + "' to " + field + " (changes the table)";
+    } else if(cmd == "rmpart") {
+      ret = "update in place: remove '" + commands[0] + "' from " + field + " (changes the table)";
+    } else if(cmd == "new") {
+      ret = "new: append an entry (changes the table), reset buffer to the whole table";
+    } else if(cmd == "get") {
+      ret = "output: field " + field;
+    } else if(cmd == "count-by") {
+      ret = "output: group by " + field + ", count";
+    } else if(cmd == "count-distinct") {
+      ret = "output: count distinct values of " + field + " (the selection isn't materialized)";
+    } else if(cmd == "count") {
+      ret = "output: entry count (the selection isn't materialized)";
+    } else if(cmd == "exists") {
+      ret = "output: true if there are entries";
+    } else if(cmd == "import" || cmd == "merge") {
+      ret = cmd + ": parse " + my_tolower(commands[0]) + " rows of " + commands[1] + " (parallel), ";
+      ret += (cmd == "merge") ? ("replace the entries with the same " + commands[2] + " and append the rest")
+                              : string("append them");
+      ret += " (changes the table), reset buffer to the whole table";
+    } else if(cmd == "save") {
+      ret = "save buffer as " + commands[0] + " (the row selection is shared)";
+    } else if(cmd == "load") {
+      ret = "load buffer " + commands[0];
+    } else if(cmd == "rm") {
+      ret = "rm: negate + push, remove the selected entries (changes the table)";
+    } else if(cmd == "rmexcept") {
+      ret = "rmexcept: push, remove everything except the selected entries (changes the table)";
+    } else if(cmd == "neg") {
+      ret = "neg: select the other entries";
+    } else if(cmd == "push") {
+      ret = "push: replace the table with the buffer (changes the table)";
+    } else if(cmd == "pull") {
+      ret = "pull: reset buffer to the whole table";
+    } else if(cmd == "print") {
+      ret = "print buffer";
+    } else if(cmd == "quit") {
+      ret = "quit";
+    }
+    if(!s.batch && exits(cmd)) ret += ", exit";
+    return ret;
+  }
+
+  int run_commands(session &s, deque<string> &commands) {
+    auto &my_ctx = s.ctx;
+    const auto &meta = s.tab.get_metadata();
+    const size_t colcnt = meta.get_field_count();
+    string cmd, field;
+
+    try {
+      while(!commands.empty()) {
+        optional<step_recorder> rec;
+        if(s.profile) rec.emplace(s, commands);
+        cmd = my_tolower(commands.front());
+        commands.pop_front();
+        string selector;
+        size_t count = 0;
+        optional<zsdatab::predicate> pred;
+        zsdatab::import_options iopts;
+
+        // check args
+        {
+          bool args_ok = true;
+          if(cmd == "ch" || cmd == "select" || cmd == "appart" || cmd == "rmpart") {
+            if(commands.size() < 2 || commands.front().empty()) args_ok = false;
+            else field = commands[0];
+            commands.pop_front();
+          } else if(cmd == "xsel") {
+            if(commands.size() < 3 || commands[0].empty() || commands[1].empty()) args_ok = false;
+            else if(!xsel_gmatcht(commands[0])) args_ok = false;
+            else field = commands[1];
+            selector = commands[0];
+            commands.pop_front();
+            commands.pop_front();
+          } else if(cmd == "where") {
+            if(commands.empty() || commands.front().empty()) args_ok = false;
+            else {
+              try {
+                pred = zsdatab::predicate::parse(commands[0]);
+              } catch(const invalid_argument &e) {
+                s.err << "zsdatab-entry: ERROR: " << s.where << "command where: " << e.what() << '\n';
+                return 1;
+              }
+              for(const auto &i : pred->fields())
+                if(!meta.has_field(i)) {
+                  field = i;
+                  throw out_of_range(__PRETTY_FUNCTION__);
+                }
+            }
+          } else if(cmd == "new") {
+            if(commands.size() < colcnt) args_ok = false;
+          } else if(cmd == "get" || cmd == "count-by" || cmd == "count-distinct") {
+            if(commands.empty() || commands.front().empty()) args_ok = false;
+            else field = commands[0];
+            commands.pop_front();
+          } else if(cmd == "limit") {
+            if(commands.empty() || !parse_count(commands[0], count)) args_ok = false;
+          } else if(cmd == "top") {
+            if(commands.size() < 3 || commands[0].empty() || !parse_count(commands[2], count)) args_ok = false;
+            else {
+              field = commands[0];
+              selector = my_tolower(commands[1]);
+              if(selector != "asc" && selector != "desc") args_ok = false;
+              commands.pop_front();
+              commands.pop_front();
+            }
+          } else if(cmd == "import" || cmd == "merge") {
+            const size_t argc = (cmd == "merge") ? 3 : 2;
+            if(commands.size() < argc || !import_format_of(my_tolower(commands[0]), iopts.format) || commands[1].empty())
+              args_ok = false;
+            else if(cmd == "merge") {
+              // KEYS = FIELD[,FIELD]...
+              size_t b = 0, e;
+              do {
+                e = commands[2].find(',', b);
+                field = commands[2].substr(b, e - b);
+                if(!meta.has_field(field)) throw out_of_range(__PRETTY_FUNCTION__);
+                iopts.key.emplace_back(field);
+                b = e + 1;
+              } while(e != string::npos);
+            }
+          } else if(cmd == "save" || cmd == "load") {
+            if(commands.empty() || commands.front().empty()) args_ok = false;
+            else if(cmd == "load" && s.saved.find(commands[0]) == s.saved.end()) {
+              s.err << "zsdatab-entry: ERROR: " << s.where << "command load: unknown context '" << commands[0] << "'\n";
+              return 1;
+            }
+          } else if(cmd == "rm" || cmd == "rmexcept" || cmd == "neg" || cmd == "quit" || cmd == "push"
+                 || cmd == "pull" || cmd == "print" || cmd == "count" || cmd == "exists") {
+            // do nothing
+          } else {
+            s.err << "zsdatab-entry: ERROR: " << s.where << "unknown command '" << cmd << "'\n";
+            return 1;
+          }
+
+          if(!args_ok) {
+            s.err << "zsdatab-entry: ERROR: " << s.where << "command " << cmd << ": invalid args\n";
+            return 1;
+          }
+        }
+
+        if(s.explain) {
+          // the field names are otherwise checked on execution
+          if(!field.empty()) meta.get_field_nr(field);
+          s.out << s.where << ++s.explained << ". " << explain(s, cmd, field, selector, commands) << '\n';
+          // load checks the saved names
+          if(cmd == "save") s.saved.emplace(commands[0], my_ctx);
+          commands.erase(commands.begin(), commands.begin() + pending_args(cmd, colcnt));
+          if(cmd == "quit" || (!s.batch && exits(cmd))) return 0;
+          continue;
+        }
+
+        // command execution
+        if(cmd == "ch" || cmd == "appart" || cmd == "rmpart") {
+          // changes the selected entries in place
+          const auto op = (cmd == "ch") ? zsdatab::mut_op::set
+                        : ((cmd == "appart") ? zsdatab::mut_op::append : zsdatab::mut_op::remove_part);
+          my_ctx.update({{op, field, commands[0], {}}});
+          commands.pop_front();
+        } else if(cmd == "select") {
+          // a following limit stops the scan early
+          my_ctx.filter(field, commands[0], true, false, peek_limit(commands, 1, !s.batch));
+          commands.pop_front();
+        } else if(cmd == "xsel") {
+          my_ctx.filter(field, commands[0], xsel_gmatcht(selector) == 1, false, peek_limit(commands, 1, !s.batch));
+          commands.pop_front();
+        } else if(cmd == "where") {
+          my_ctx.filter(*pred, peek_limit(commands, 1, !s.batch));
+          commands.pop_front();
+        } else if(cmd == "limit") {
+          my_ctx.limit(count);
+          commands.pop_front();
+        } else if(cmd == "top") {
+          my_ctx.top_k({{field, (selector == "desc") ? zsdatab::desc : zsdatab::asc}}, count);
+          commands.pop_front();
+        } else if(cmd == "new") {
+          const auto cbi = commands.begin();
+          const auto cei = cbi + colcnt;
+          const vector<string> line(cbi, cei);
+          commands.erase(cbi, cei);
+
+          my_ctx.pull();
+          my_ctx += line;
+          my_ctx.push();
+        } else if(cmd == "get") {
+          for(auto &&l : my_ctx.get_column_data(field))
+            s.out << l << '\n';
+          if(!s.batch) return 0;
+        } else if(cmd == "count-by") {
+          s.out << my_ctx.group_by({field}).agg({{zsdatab::agg::count, {}}});
+          if(!s.batch) return 0;
+        } else if(cmd == "count-distinct") {
+          s.out << my_ctx.count_distinct(field) << '\n';
+          if(!s.batch) return 0;
+        } else if(cmd == "count") {
+          // the selection isn't materialized
+          s.out << my_ctx.count() << '\n';
+          if(!s.batch) return 0;
+        } else if(cmd == "exists") {
+          // outside of scripts, a preceding select/xsel/where stopped at the first match
+          const bool ret = my_ctx.exists();
+          s.out << (ret ? "true" : "false") << '\n';
+          if(!s.batch) return ret ? 0 : 1;
+        } else if(cmd == "import" || cmd == "merge") {
+          // the whole input is parsed and validated before the table is changed
+          string src = commands[1];
+          try {
+            if(src == "-") {
+              if(!s.in) {
+                s.err << "zsdatab-entry: ERROR: " << s.where << "command " << cmd << ": stdin isn't available\n";
+                return 1;
+              }
+              s.tab.import_rows(*s.in, iopts);
+            } else {
+              if(src.front() != '/' && !s.cwd.empty()) src = s.cwd + '/' + src;
+              ifstream in(src);
+              if(!in) {
+                s.err << "zsdatab-entry: ERROR: " << s.where << "command " << cmd << ": " << commands[1] << ": file not found\n";
+                return 1;
+              }
+              s.tab.import_rows(in, iopts);
+            }
+          } catch(const zsdatab::import_error &e) {
+            s.err << "zsdatab-entry: ERROR: " << s.where << "command " << cmd << ": " << commands[1] << ": " << e.what() << '\n';
+            return 1;
+          }
+          commands.erase(commands.begin(), commands.begin() + ((cmd == "merge") ? 3 : 2));
+          my_ctx.pull();
+        } else if(cmd == "save") {
+          // only the row selection is copied
+          const auto it = s.saved.find(commands[0]);
+          if(it == s.saved.end()) s.saved.emplace(commands[0], my_ctx);
+          else {
+            zsdatab::context tmp(my_ctx);
+            it->second.swap(tmp);
+          }
+          commands.pop_front();
+        } else if(cmd == "load") {
+          s.assign(s.saved.find(commands[0])->second);
+          commands.pop_front();
+        } else if(cmd == "rm") {
+          my_ctx.negate();
+          my_ctx.push();
+        } else if(cmd == "rmexcept")
+          my_ctx.push();
+        else if(cmd == "neg")
+          my_ctx.negate();
+        else if(cmd == "push")
+          my_ctx.push();
+        else if(cmd == "pull")
+          my_ctx.pull();
+        else if(cmd == "print")
+          s.out << my_ctx;
+        else if(cmd == "quit")
+          return 0;
+      }
+    } catch(const out_of_range&e) {
+      s.err << "zsdatab-entry: ERROR: " << s.where << "command " << cmd << ": unknown fieldname '" << field << "'\n";
+      return 1;
+    }
+
+    return -1;
+  }
+
+  bool split_line(const string &line, deque<string> &words) {
+    const size_t n = line.size();
+    size_t i = 0;
+    for(;;) {
+      while(i < n && isspace(static_cast<unsigned char>(line[i]))) ++i;
+      if(i == n || line[i] == '#') return true;
+
+      string w;
+      while(i < n && !isspace(static_cast<unsigned char>(line[i]))) {
+        const char c = line[i++];
+        if(c == '\'') {
+          const size_t e = line.find('\'', i);
+          if(e == string::npos) return false;
+          w.append(line, i, e - i);
+          i = e + 1;
+        } else if(c == '"') {
+          for(;; ++i) {
+            if(i == n) return false;
+            if(line[i] == '"') break;
+            if(line[i] == '\\' && i + 1 < n) ++i;
+            w += line[i];
+          }
+          ++i;
+        } else if(c == '\\' && i < n) {
+          w += line[i++];
+        } else {
+          w += c;
+        }
+      }
+      words.emplace_back(move(w));
+    }
+  }
+
+  int run_script(session &s, istream &in, const string &name) {
+    string line;
+    size_t lineno = 0;
+    while(getline(in, line)) {
+      ++lineno;
+      s.where = name + ':' + to_string(lineno) + ": ";
+      deque<string> commands;
+      if(!split_line(line, commands)) {
+        s.err << "zsdatab-entry: ERROR: " << s.where << "unterminated quote\n";
+        return 1;
+      }
+      const int ret = run_commands(s, commands);
+      if(ret != -1) return ret;
+    }
+    return 0;
+  }
+
+
+  int run_args(session &s, deque<string> &commands) {
+    const int ret = run_commands(s, commands);
+    if(ret != -1) return ret;
+
+    // print buffer
+    if(s.explain) s.out << ++s.explained << ". print buffer\n";
+    else s.out << s.ctx;
+    return 0;
+  }
+
+  static void profile_line(ostream &o, const bool hw, const string &name, const string &rows_in,
+                           const string &rows_out, const string &bytes, const zsdatab::io_stats::stage &t)
+  {
+    typedef chrono::duration<double, milli> ms;
+    char tmp[256];
+    int n = snprintf(tmp, sizeof(tmp), "  %-40.40s %10s %10s %12s %10.3f %10.3f", name.c_str(),
+                     rows_in.c_str(), rows_out.c_str(), bytes.c_str(), ms(t.wall).count(), ms(t.cpu).count());
+    if(hw && t.hw.valid)
+      n += snprintf(tmp + n, sizeof(tmp) - n, " %14llu %14llu %12llu %12llu",
+                    static_cast<unsigned long long>(t.hw.cycles), static_cast<unsigned long long>(t.hw.instructions),
+                    static_cast<unsigned long long>(t.hw.cache_misses), static_cast<unsigned long long>(t.hw.branch_misses));
+    o << tmp << '\n';
+  }
+
+  void print_profile(const session &s, const zsdatab::io_stats &prev, const bool loaded) {
+    const auto io = s.tab.get_io_stats();
+    // hardware counters, if enable_hw_counters succeeded
+    const bool hw = zsdatab::read_hw_counters().valid;
+    char tmp[256];
+    int n = snprintf(tmp, sizeof(tmp), "  %-40s %10s %10s %12s %10s %10s", "stage", "rows in", "rows out", "bytes", "wall ms", "cpu ms");
+    if(hw)
+      snprintf(tmp + n, sizeof(tmp) - n, " %14s %14s %12s %12s", "cycles", "instructions", "cache-misses", "branch-misses");
+    s.err << "zsdatab-entry: profile (cpu = CPU time of the whole process)\n" << tmp << '\n';
+
+    if(loaded) {
+      profile_line(s.err, hw, "lock wait", {}, {}, {}, io.lock_wait);
+      profile_line(s.err, hw, "read", {}, {}, to_string(io.bytes_read), io.read);
+      profile_line(s.err, hw, "parse", {}, to_string(io.rows_loaded), {}, io.parse);
+    }
+    for(const auto &i : s.steps)
+      profile_line(s.err, hw, i.command, to_string(i.rows_in), to_string(i.rows_out), {}, i.time);
+
+    if(io.serialize.wall != prev.serialize.wall || io.write.wall != prev.write.wall) {
+      profile_line(s.err, hw, "serialize", {}, {}, {}, io.serialize);
+      profile_line(s.err, hw, "write", {}, {}, to_string(io.bytes_written), io.write);
+      profile_line(s.err, hw, "fsync", {}, {}, {}, io.fsync);
+    } else {
+      s.err << "  (no write-back, the table is unchanged)\n";
+    }
+  }
+
+  auto socket_path() -> string {
+    if(const char *env = getenv("ZSDATAB_SOCKET")) return env;
+    if(const char *env = getenv("XDG_RUNTIME_DIR"))
+      if(*env) return string(env) + "/zsdatab.sock";
+    return "/tmp/zsdatab-" + to_string(getuid()) + ".sock";
+  }
+
+  bool same_user(const int fd) {
+    ucred cred;
+    socklen_t len = sizeof(cred);
+    return !getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) && cred.uid == geteuid();
+  }
+
+  static bool write_all(const int fd, const char *data, size_t n) {
+    while(n) {
+      const ssize_t r = send(fd, data, n, MSG_NOSIGNAL);
+      if(r < 0) {
+        if(errno == EINTR) continue;
+        return false;
+      }
+      data += r;
+      n -= r;
+    }
+    return true;
+  }
+
+  static bool read_all(const int fd, char *data, size_t n) {
+    while(n) {
+      const ssize_t r = read(fd, data, n);
+      if(r < 0 && errno == EINTR) continue;
+      if(r <= 0) return false;
+      data += r;
+      n -= r;
+    }
+    return true;
+  }
+
+  // read_count - read a "NUMBER\n" header, NUMBER <= max
+  static bool read_count(const int fd, size_t &ret, const size_t max) {
+    ret = 0;
+    for(size_t i = 0; i < 20; ++i) {
+      char c;
+      if(!read_all(fd, &c, 1)) return false;
+      if(c == '\n') return i > 0;
+      if(!isdigit(c)) return false;
+      const size_t d = c - '0';
+      if(d > max || ret > (max - d) / 10) return false;
+      ret = ret * 10 + d;
+    }
+    return false;
+  }
+
+  bool write_message(const int fd, const vector<string> &msg) {
+    string head = to_string(msg.size()) + '\n';
+    if(!write_all(fd, head.data(), head.size())) return false;
+    for(const auto &i : msg) {
+      head = to_string(i.size()) + '\n';
+      if(!write_all(fd, head.data(), head.size()) || !write_all(fd, i.data(), i.size()))
+        return false;
+    }
+    return true;
+  }
+
+  bool read_message(const int fd, vector<string> &msg, const size_t max_strings, size_t max_size) {
+    size_t n;
+    if(!read_count(fd, n, max_strings)) return false;
+    msg.clear();
+    msg.reserve(min<size_t>(n, 1024));
+    for(size_t i = 0; i < n; ++i) {
+      size_t len;
+      if(!read_count(fd, len, max_size)) return false;
+      max_size -= len;
+      string tmp(len, '\0');
+      if(!read_all(fd, tmp.data(), len)) return false;
+      msg.emplace_back(move(tmp));
+    }
+    return true;
+  }
+}
@@ -0,0 +1,99 @@
+/*******************************************************************************
+ *  header: zsdatab-entry commands, client/server protocol
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *******************************************************************************/
+#pragma once
+#include "zsdatable.hpp"
+
+#include <deque>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace zsdatab_entry {
+  // step_stats - costs of one command (profile mode)
+  struct step_stats {
+    std::string command;
+    size_t rows_in, rows_out;
+    zsdatab::io_stats::stage time;
+  };
+
+  // session - state shared by all commands of an invocation (or a script)
+  struct session {
+    zsdatab::table &tab;
+    zsdatab::context ctx;
+    std::map<std::string, zsdatab::context> saved;
+    // batch mode: get and count-by don't exit
+    bool batch;
+    // error location prefix (script:line: in batch mode)
+    std::string where;
+    std::ostream &out, &err;
+    // input of import - (nullptr if there is none) and directory of relative import files
+    std::istream *in;
+    std::string cwd;
+    // profile mode: the costs of every command are collected in steps
+    bool profile = false;
+    std::vector<step_stats> steps;
+    // explain mode: the commands are checked and described, but not executed
+    bool explain = false;
+    size_t explained = 0;
+
+    session(zsdatab::table &t, const bool b, std::ostream &o, std::ostream &e, std::istream *i = nullptr)
+      : tab(t), ctx(t), batch(b), out(o), err(e), in(i) { }
+
+    void assign(const zsdatab::context &o) {
+      zsdatab::context tmp(o);
+      ctx.swap(tmp);
+    }
+  };
+
+  /* run_commands - execute a command list
+   * @return : -1 to go on, otherwise the exit code
+   */
+  int run_commands(session &s, std::deque<std::string> &commands);
+
+  // run_args - run_commands + print the buffer (if no command exited)
+  int run_args(session &s, std::deque<std::string> &commands);
+
+  /* split_line - split a script line into words
+   * words are separated by whitespace, '...' and "..." quote (\ escapes inside "...")
+   * and # starts a comment
+   * @return : false if a quote isn't closed
+   */
+  bool split_line(const std::string &line, std::deque<std::string> &words);
+
+  // run_script - run every line of in against one session
+  int run_script(session &s, std::istream &in, const std::string &name);
+
+  /* print_profile - print the costs of the session to s.err
+   * loaded: the table was loaded by this session (lock wait, read, parse are printed)
+   * prev:   io stats before the write-back, the write-back is printed if it ran since then
+   */
+  void print_profile(const session &s, const zsdatab::io_stats &prev, const bool loaded);
+
+  /* client/server protocol (zsdatab-server)
+   * a message is a list of strings: "COUNT\n" followed by "LENGTH\n" DATA for every string
+   * request:  proto_magic, "args"|"script", FLAGS, TABLE, CWD, "<"STDIN|"" (if import reads it),
+   *           (WORDS...|SCRIPTNAME SCRIPT)
+   *           FLAGS = letters: z = gzipped table, p = profile
+   * response: EXITCODE, STDOUT, STDERR
+   */
+  constexpr const char *proto_magic = "zsdatab/1";
+  // limits of a request (the server rejects larger ones)
+  constexpr size_t max_request_strings = 0x100000;
+  constexpr size_t max_request_size = 0x40000000;
+
+  // socket_path - $ZSDATAB_SOCKET, $XDG_RUNTIME_DIR/zsdatab.sock or /tmp/zsdatab-UID.sock
+  // (empty if $ZSDATAB_SOCKET is set, but empty)
+  auto socket_path() -> std::string;
+
+  // same_user - check if the peer of the socket fd runs as the current user
+  // (anybody may create /tmp/zsdatab-UID.sock)
+  bool same_user(const int fd);
+
+  bool write_message(const int fd, const std::vector<std::string> &msg);
+  // read_message - fails if msg would have more than max_strings strings or max_size bytes
+  bool read_message(const int fd, std::vector<std::string> &msg, const size_t max_strings, size_t max_size);
+}
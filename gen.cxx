@@ -0,0 +1,305 @@
+/*******************************************************************************
+ * program: zsdatab-gen
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *******************************************************************************
+ * Copyright (C) 2021 zseri
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *******************************************************************************/
+
+#include "zsdatable.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+  // rows per chunk (the output doesn't depend on the thread count)
+  constexpr size_t chunk_rows = 0x10000;
+
+  // splitmix64 - seeds and value hashes
+  inline uint64_t mix(uint64_t x) noexcept {
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+  }
+
+  class rng final {
+    uint64_t _s;
+
+   public:
+    explicit rng(const uint64_t seed) noexcept : _s(seed) { }
+
+    uint64_t operator()() noexcept
+      { return mix(_s++); }
+    // uniform in [0, n)
+    uint64_t below(const uint64_t n) noexcept
+      { return n ? ((*this)() % n) : 0; }
+    // uniform in [0, 1)
+    double unit() noexcept
+      { return ((*this)() >> 11) * 0x1.0p-53; }
+  };
+
+  /* column - NAME[,OPTION]...
+   * card=N (0 = unique), zipf, len=N|MIN-MAX, esc=FRACTION
+   */
+  struct column {
+    string name;
+    uint64_t card = 0;
+    bool zipf = false;
+    size_t len_min = 8, len_max = 8;
+    double esc = -1;
+  };
+
+  bool parse_column(const string &spec, column &col) {
+    istringstream in(spec);
+    string opt;
+    getline(in, col.name, ',');
+    if(col.name.empty()) return false;
+    while(getline(in, opt, ',')) {
+      const size_t eq = opt.find('=');
+      const string key = opt.substr(0, eq), val = (eq == string::npos) ? string() : opt.substr(eq + 1);
+      char *end = nullptr;
+      if(key == "zipf" && eq == string::npos) {
+        col.zipf = true;
+      } else if(key == "card" && !val.empty()) {
+        col.card = strtoull(val.c_str(), &end, 10);
+        if(*end) return false;
+      } else if(key == "len" && !val.empty()) {
+        col.len_min = col.len_max = strtoul(val.c_str(), &end, 10);
+        if(*end == '-') col.len_max = strtoul(end + 1, &end, 10);
+        if(*end || col.len_max < col.len_min) return false;
+      } else if(key == "esc" && !val.empty()) {
+        col.esc = strtod(val.c_str(), &end);
+        if(*end || col.esc < 0 || col.esc > 1) return false;
+      } else {
+        return false;
+      }
+    }
+    return !(col.zipf && !col.card);
+  }
+
+  class generator final {
+    const zsdatab::metadata &_meta;
+    const vector<column> &_cols;
+    const uint64_t _seed, _rows;
+
+    /* value - the value number v of column c (the same for every row)
+     * the end holds v in base 36 (if it fits), so values are distinct
+     */
+    string value(const size_t c, const uint64_t v) const {
+      static const char alnum[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+      const auto &col = _cols[c];
+      rng r(mix(mix(_seed ^ mix(c + 1)) ^ v));
+
+      string ret(col.len_min + r.below(col.len_max - col.len_min + 1), '\0');
+      for(auto &i : ret) i = alnum[r.below(26)];
+      size_t pos = ret.size();
+      for(uint64_t x = v; pos && x; x /= 36) ret[--pos] = alnum[x % 36];
+
+      // escaped characters
+      if(r.unit() < col.esc) {
+        switch(r.below(4)) {
+          case 0: ret.clear(); break;
+          case 1: ret.insert(r.below(ret.size() + 1), 1, _meta.separator()); break;
+          case 2: ret.insert(r.below(ret.size() + 1), 1, '\n'); break;
+          default: ret.insert(r.below(ret.size() + 1), 1, '\\'); break;
+        }
+      }
+      return ret;
+    }
+
+    uint64_t pick(const column &col, const uint64_t row, rng &r) const {
+      if(!col.card) return row;
+      if(!col.zipf) return r.below(col.card);
+      // the k-th value has a frequency of ~ 1/k (inverse of the continuous CDF)
+      const uint64_t v = static_cast<uint64_t>(exp(r.unit() * log(col.card + 1.0))) - 1;
+      return min(v, col.card - 1);
+    }
+
+   public:
+    generator(const zsdatab::metadata &meta, const vector<column> &cols, const uint64_t seed, const uint64_t rows)
+      : _meta(meta), _cols(cols), _seed(seed), _rows(rows) { }
+
+    // chunk - the serialized rows of chunk n
+    string chunk(const uint64_t n) const {
+      const uint64_t from = n * chunk_rows, to = min<uint64_t>(_rows, from + chunk_rows);
+      rng r(mix(mix(_seed) ^ n));
+      string ret;
+      zsdatab::row_t row(_cols.size());
+      for(uint64_t i = from; i < to; ++i) {
+        for(size_t c = 0; c < _cols.size(); ++c)
+          row[c] = value(c, pick(_cols[c], i, r));
+        ret += _meta.serialize(row);
+        ret += '\n';
+      }
+      return ret;
+    }
+  };
+
+  // gzip_member - compress data into a complete gzip member (members can be concatenated)
+  bool gzip_member(const string &data, string &out) {
+    z_stream zs = {};
+    if(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      return false;
+    out.resize(deflateBound(&zs, data.size()));
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    zs.avail_in = data.size();
+    zs.next_out = reinterpret_cast<Bytef *>(out.data());
+    zs.avail_out = out.size();
+    const bool ok = (deflate(&zs, Z_FINISH) == Z_STREAM_END);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ok;
+  }
+
+  bool exists(const string &path) {
+    struct stat st;
+    return !stat(path.c_str(), &st);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  string format = "plain";
+  uint64_t rows = 1000, seed = 1;
+  double esc = 0;
+  char sep = ':';
+  bool ok = true;
+  int opt;
+  while(ok && (opt = getopt(argc, argv, "f:n:s:e:d:")) != -1) {
+    char *end = nullptr;
+    switch(opt) {
+      case 'f': format = optarg; ok = (format == "plain" || format == "packed" || format == "gzipped"); break;
+      case 'n': rows = strtoull(optarg, &end, 10); ok = !*end; break;
+      case 's': seed = strtoull(optarg, &end, 10); ok = !*end; break;
+      case 'e': esc = strtod(optarg, &end); ok = !*end && esc >= 0 && esc <= 1; break;
+      case 'd': sep = optarg[0]; ok = optarg[0] && !optarg[1] && sep != '\\' && sep != '\n'; break;
+      default: ok = false;
+    }
+  }
+
+  vector<column> cols;
+  for(int i = optind + 1; ok && i < argc; ++i) {
+    cols.emplace_back();
+    ok = parse_column(argv[i], cols.back());
+    if(!ok) cerr << "zsdatab-gen: ERROR: invalid column '" << argv[i] << "'\n";
+  }
+
+  if(!ok || argc - optind < 2) {
+    cerr << "USAGE: zsdatab-gen [-f plain|packed|gzipped] [-n ROWS] [-s SEED] [-e FRACTION] [-d SEP] TABLE COLUMN...\n"
+            "\n"
+            "Writes a new table with ROWS (default: 1000) generated entries; the same\n"
+            "arguments and SEED (default: 1) always give the same table\n"
+            "\n"
+            "Options:\n"
+            "  -f FORMAT     table format (default: plain = TABLE and TABLE.meta)\n"
+            "  -e FRACTION   fraction of values which are empty or contain the separator,\n"
+            "                a newline or a backslash (default: 0)\n"
+            "  -d SEP        column separator (default: ':')\n"
+            "\n"
+            "Columns: NAME[,OPTION]...\n"
+            "  card=N        N distinct values (default: every entry gets its own value)\n"
+            "  zipf          the k-th value is ~ 1/k as frequent (default: uniform, needs card)\n"
+            "  len=N         values with N characters (default: 8)\n"
+            "  len=MIN-MAX   uniformly distributed lengths\n"
+            "  esc=FRACTION  escape fraction of this column (default: -e)\n"
+            "\n"
+            "e.g. zsdatab-gen -n 100000000 -f gzipped big id,len=12 status,card=5,zipf text,len=10-200\n"
+            "\n"
+            "zsdatab v0.3.1 by zseri <zseri.devel@ytrizja.de>\n"
+            "released under LGPL-2.1-or-later\n";
+    return 1;
+  }
+
+  const string path = argv[optind];
+  if(exists(path) || (format == "plain" && exists(path + ".meta"))) {
+    cerr << "zsdatab-gen: ERROR: " << path << ": table already exists\n";
+    return 1;
+  }
+
+  zsdatab::row_t names;
+  for(auto &i : cols) {
+    if(i.esc < 0) i.esc = esc;
+    names.emplace_back(i.name);
+  }
+  const zsdatab::metadata meta(sep, names);
+
+  // metadata
+  string head;
+  {
+    ostringstream tmp;
+    tmp << meta;
+    head = tmp.str();
+  }
+  if(format == "plain") {
+    ofstream m(path + ".meta");
+    m << head;
+    if(!m.flush()) {
+      cerr << "zsdatab-gen: ERROR: " << path << ".meta: write failed\n";
+      return 1;
+    }
+    head.clear();
+  } else if(format == "gzipped") {
+    string tmp;
+    if(!gzip_member(head, tmp)) {
+      cerr << "zsdatab-gen: ERROR: compression failed\n";
+      return 1;
+    }
+    head.swap(tmp);
+  }
+
+  ofstream out(path, ios::binary);
+  out.write(head.data(), head.size());
+
+  // the chunks are generated (and compressed) in parallel, in batches, and written in order
+  const generator gen(meta, cols, seed, rows);
+  const bool gz = (format == "gzipped");
+  const auto ex = zsdatab::get_executor();
+  const uint64_t chunks = (rows + chunk_rows - 1) / chunk_rows;
+  const uint64_t batch = max<size_t>(1, ex->concurrency() * 2);
+  vector<string> bufs;
+  atomic<bool> gz_ok(true);
+  for(uint64_t b = 0; out && b < chunks; b += batch) {
+    bufs.assign(min(batch, chunks - b), string());
+    ex->run(bufs.size(), [&](const size_t i) {
+      string data = gen.chunk(b + i);
+      if(gz && !gzip_member(data, bufs[i])) gz_ok = false;
+      else if(!gz) bufs[i].swap(data);
+    });
+    for(const auto &i : bufs)
+      out.write(i.data(), i.size());
+  }
+  out.close();
+
+  if(!gz_ok || !out) {
+    cerr << "zsdatab-gen: ERROR: " << path << ": " << (gz_ok ? "write" : "compression") << " failed\n";
+    return 1;
+  }
+  return 0;
+}
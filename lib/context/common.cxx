@@ -6,63 +6,322 @@
  **********************************************/
 
 #include "zsdatable.hpp"
-#define ZSDA_PAR
-#include <config.h>
+#include "table/common.hpp"
+#include "distinct.hpp"
+#include "instrument.hpp"
+#include "pool.hpp"
+#include "sort.hpp"
+#include "strsearch.hpp"
 #include <algorithm>
+#include <numeric>
+#include <unordered_set>
 
 using namespace std;
 
 namespace zsdatab {
   namespace intern {
+    /* gather_rows - build a store from the selected rows of base
+     * (only the row pointers are copied, or moved if base isn't shared)
+     */
+    static auto gather_rows(shared_ptr<const row_store> &base, const vector<size_t> &sel) -> shared_ptr<const row_store> {
+      auto ret = make_shared<row_store>();
+      ret->reserve(sel.size());
+      if(base.use_count() == 1) {
+        // base always points to a non-const row_store
+        auto &src = const_cast<row_store&>(*base);
+        for(const auto i : sel) ret->emplace_back(move(src[i]));
+        base.reset();
+      } else {
+        for(const auto i : sel) ret->emplace_back((*base)[i]);
+      }
+      return ret;
+    }
+
+    static bool is_identity(const vector<size_t> &sel, const size_t n) noexcept {
+      if(sel.size() != n) return false;
+      for(size_t i = 0; i < n; ++i)
+        if(sel[i] != i) return false;
+      return true;
+    }
+
+    context_common::context_common(const buffer_interface &bif)
+      : _base(share_rows(bif.rows())), _sel_all(true) { }
+
+    context_common::context_common(const table_interface &tab)
+      : _base(tab.shared_rows()), _sel_all(true) { }
+
+    context_common::context_common(const buffer_t &o)
+      : _base(make_row_store(buffer_t(o))), _sel_all(true) { }
+
+    context_common::context_common(buffer_t &&o)
+      : _base(make_row_store(move(o))), _sel_all(true) { }
+
+    auto context_common::rows() const noexcept -> row_view {
+      if(!_base) return {};
+      return _sel_all ? row_view(*_base) : row_view(*_base, _sel);
+    }
+
+    auto context_common::data() const -> const buffer_t& {
+      // concurrent const calls fill the cache once
+      lock_guard<mutex> lock(cache_mutex(this));
+      materialize();
+      if(!_cache || _cache_src.lock() != _base) {
+        auto tmp = make_shared<buffer_t>();
+        tmp->reserve(_base->size());
+        for(const auto &i : *_base)
+          tmp->emplace_back(*i);
+        _cache = move(tmp);
+        _cache_src = _base;
+      }
+      return *_cache;
+    }
+
+    auto context_common::data_move_out() && -> buffer_t&& {
+      // rows which aren't shared are moved
+      auto &st = own();
+      auto tmp = make_shared<buffer_t>();
+      tmp->reserve(st.size());
+      for(auto &i : st) {
+        if(i.use_count() == 1) tmp->emplace_back(move(mutable_row(i)));
+        else                   tmp->emplace_back(*i);
+      }
+      st.clear();
+      _cache = tmp;
+      return move(*tmp);
+    }
+
+    auto context_common::sel() -> vector<size_t>& {
+      if(_sel_all) {
+        _sel.resize(_base ? _base->size() : 0);
+        iota(_sel.begin(), _sel.end(), 0);
+        _sel_all = false;
+      }
+      return _sel;
+    }
+
+    void context_common::select_positions(const vector<size_t> &pos) {
+      if(_sel_all) {
+        _sel = pos;
+        _sel_all = false;
+      } else {
+        vector<size_t> tmp(pos.size());
+        transform(pos.begin(), pos.end(), tmp.begin(), [this](const size_t i) noexcept { return _sel[i]; });
+        _sel.swap(tmp);
+      }
+    }
+
+    auto context_common::materialize() const -> const shared_ptr<const row_store>& {
+      if(!_base) {
+        _base = make_shared<row_store>();
+        _sel.clear();
+        _sel_all = true;
+      } else if(!_sel_all) {
+        if(!is_identity(_sel, _base->size()))
+          _base = gather_rows(_base, _sel);
+        _sel.clear();
+        _sel_all = true;
+      }
+      return _base;
+    }
+
+    auto context_common::own() -> row_store& {
+      materialize();
+      // copy on write (the row pointers only)
+      if(_base.use_count() != 1)
+        _base = make_shared<row_store>(*_base);
+      _cache.reset();
+      _cache_src.reset();
+      return const_cast<row_store&>(*_base);
+    }
+
+    auto context_common::mutable_row(row_ptr &p) -> row_t& {
+      return cow_row(p);
+    }
+
+    void context_common::swap_rows(context_common &o) noexcept {
+      _base.swap(o._base);
+      _sel.swap(o._sel);
+      std::swap(_sel_all, o._sel_all);
+      _cache.swap(o._cache);
+      _cache_src.swap(o._cache_src);
+    }
+
     context_common& context_common::pull() {
-      _buffer = get_const_table().data();
+      _base = get_const_table().shared_rows();
+      _sel.clear();
+      _sel_all = true;
       return *this;
     }
 
     // select
     context_common& context_common::sort() {
       const size_t colcnt = get_metadata().get_field_count();
-      std::sort(ZSDAM_PAR _buffer.begin(), _buffer.end(),
-        [colcnt](const row_t &a, const row_t &b) noexcept {
-          for(size_t i = 0; i < colcnt; ++i) {
-            if(a[i] < b[i]) return true;
-            else if(a[i] > b[i]) break;
-          }
-          return false;
-        }
-      );
+      sort_columns cols;
+      cols.reserve(colcnt);
+      for(size_t i = 0; i < colcnt; ++i)
+        cols.push_back({i, asc});
+      return sort(cols);
+    }
 
+    context_common& context_common::sort(const sort_columns &cols, const bool stable) {
+      if(!cols.empty() && rows().size() > 1) {
+        op_timer t(event_type::sort, rows().size());
+        select_positions(sort_rows(rows(), cols, stable));
+        t.rows_out(rows().size());
+      }
       return *this;
     }
 
     context_common& context_common::uniq() {
       if(!empty()) {
         sort();
-        _buffer.erase(
-          std::unique(ZSDAM_PAR _buffer.begin(), _buffer.end()),
-          _buffer.end()
-        );
+        const auto &b = *_base;
+        auto &s = sel();
+        vector<char> keep(s.size());
+        parallel_for(par_op::uniq, s.size(), [&b, &s, &keep](const size_t from, const size_t to) noexcept {
+          for(size_t i = from; i < to; ++i)
+            keep[i] = !i || !(b[s[i - 1]] == b[s[i]] || *b[s[i - 1]] == *b[s[i]]);
+        });
+        compact_kept(s, keep);
       }
 
       return *this;
     }
 
+    context_common& context_common::distinct() {
+      if(rows().size() < 2) return *this;
+
+      const auto &b = *_base;
+      auto &s = sel();
+      vector<size_t> hashes(s.size());
+      parallel_for(par_op::distinct, s.size(), [&b, &s, &hashes](const size_t from, const size_t to) noexcept {
+        for(size_t i = from; i < to; ++i)
+          hashes[i] = hash_row(*b[s[i]]);
+      });
+      compact_kept(s, hash_distinct(hashes, [&b, &s](const size_t x, const size_t y) noexcept {
+        return b[s[x]] == b[s[y]] || *b[s[x]] == *b[s[y]];
+      }));
+
+      return *this;
+    }
+
     context_common& context_common::negate() {
-      if(empty())
+      if(empty()) {
         pull();
-      else if(_buffer == get_const_table().data())
+      } else if(_sel_all && _base == get_const_table().shared_rows()) {
         clear();
-      else {
-        const buffer_t oldbuf = _buffer;
+      } else {
+        // keep the old rows alive while the set is used
+        const auto oldbase = _base;
+        const auto oldrows = rows();
+        const auto hf = [](const row_t *r) noexcept { return hash_row(*r); };
+        const auto ef = [](const row_t *a, const row_t *b) noexcept { return a == b || *a == *b; };
+        unordered_set<const row_t*, decltype(hf), decltype(ef)> oldset(oldrows.size(), hf, ef);
+        for(const auto &i : oldrows)
+          oldset.insert(&i);
+
         pull();
+        const auto &b = *_base;
+        parallel_filter(par_op::negate, sel(), [&b, &oldset](const size_t i) noexcept {
+          return oldset.find(b[i].get()) == oldset.end();
+        });
+      }
+
+      return *this;
+    }
+
+    context_common& context_common::top_k(const sort_columns &cols, const size_t k) {
+      if(cols.empty()) return limit(k);
+      op_timer t(event_type::sort, rows().size());
+      select_positions(top_k_rows(rows(), cols, k));
+      t.rows_out(rows().size());
+      return *this;
+    }
+
+    // filter_term with a precomputed substring searcher
+    struct compiled_term {
+      filter_term t;
+      substring_searcher srch;
+
+      explicit compiled_term(const filter_term &o)
+        : t(o), srch(o.whole ? string() : o.value) { }
+
+      [[gnu::hot]]
+      bool operator()(const row_t &row) const noexcept {
+        const auto &s = row[t.field];
+        return t.neg != (t.whole ? (s == t.value) : srch.in(s));
+      }
+    };
+
+    /* order_filter_terms - put the cheapest and most selective terms first
+     * rank = cost / rejection rate; the rejection rate is measured on a sample
+     * of the buffer (or guessed for small buffers)
+     */
+    static vector<compiled_term> order_filter_terms(const row_view &buf, vector<compiled_term> terms) {
+      constexpr size_t sample_min = 0x400, sample_size = 0x100;
+      vector<pair<double, size_t>> ranks;
+      ranks.reserve(terms.size());
+
+      for(size_t i = 0; i < terms.size(); ++i) {
+        const auto &ct = terms[i];
+        const auto &t = ct.t;
+        const double cost = t.whole ? 1 : (2 + t.value.size() / 16.0);
+        double rej;
+        if(buf.size() < sample_min) {
+          rej = t.neg ? 0.1 : (t.whole ? 0.9 : 0.7);
+        } else {
+          const size_t stride = buf.size() / sample_size;
+          size_t rejected = 0;
+          for(size_t j = 0; j < sample_size; ++j)
+            rejected += !ct(buf[j * stride]);
+          rej = (rejected + 0.5) / (sample_size + 1);
+        }
+        ranks.emplace_back(cost / rej, i);
+      }
+
+      stable_sort(ranks.begin(), ranks.end(), [](const auto &a, const auto &b) noexcept {
+        return a.first < b.first;
+      });
+
+      vector<compiled_term> ret;
+      ret.reserve(terms.size());
+      for(const auto &i : ranks)
+        ret.emplace_back(move(terms[i.second]));
+      return ret;
+    }
+
+    context_common& context_common::filter(const vector<filter_term> &terms, const size_t limit) {
+      if(empty()) return *this;
+      if(terms.empty()) return this->limit(limit);
+      op_timer t(event_type::filter, rows().size());
+
+      vector<compiled_term> cterms;
+      cterms.reserve(terms.size());
+      for(const auto &i : terms)
+        cterms.emplace_back(i);
+      if(cterms.size() > 1)
+        cterms = order_filter_terms(rows(), move(cterms));
+
+      const auto match = [&cterms](const row_t &row) noexcept {
+        for(const auto &t : cterms)
+          if(!t(row))
+            return false;
+        return true;
+      };
 
-        _buffer.erase(
-          remove_if(ZSDAM_PAR _buffer.begin(), _buffer.end(), [&oldbuf](const row_t &arg) noexcept {
-            return find(oldbuf.begin(), oldbuf.end(), arg) != oldbuf.end(); // assuming no overflow
-          }),
-          _buffer.end());
+      const auto &b = *_base;
+      if(limit == string::npos) {
+        parallel_filter(par_op::filter, sel(), [&b, &match](const size_t i) noexcept { return match(*b[i]); });
+      } else {
+        // sequential streaming scan, stops after 'limit' matches
+        const auto v = rows();
+        vector<size_t> pos;
+        for(size_t i = 0; i < v.size() && pos.size() < limit; ++i)
+          if(match(v[i])) pos.push_back(i);
+        select_positions(pos);
       }
 
+      t.rows_out(rows().size());
       return *this;
     }
 
@@ -70,13 +329,11 @@ namespace zsdatab {
       if(empty()) return *this;
 
       using namespace std;
-      _buffer.erase(
-        remove_if(ZSDAM_PAR _buffer.begin(), _buffer.end(),
-          [field, &value, whole, neg](const row_t &s) noexcept {
-            return neg != ((s[field].find(value) == string::npos) || (whole && s[field] != value)); // assuming no overflow
-          }
-        ),
-        _buffer.end());
+      const compiled_term ct({field, value, whole, neg});
+      op_timer t(event_type::filter, rows().size());
+      const auto &b = *_base;
+      parallel_filter(par_op::filter, sel(), [&b, &ct](const size_t i) noexcept { return ct(*b[i]); });
+      t.rows_out(rows().size());
 
       return *this;
     }
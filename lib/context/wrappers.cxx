@@ -6,7 +6,10 @@
  **********************************************/
 
 #include "zsdatable.hpp"
+#include "parse.hpp"
+#include "table/common.hpp"
 #include <algorithm>
+#include <numeric>
 #include <stdexcept>
 
 using namespace std;
@@ -15,7 +18,41 @@ namespace zsdatab {
   namespace intern {
     // select
     context_common& context_common::clear() noexcept {
-      _buffer.clear();
+      _sel.clear();
+      _sel_all = false;
+      return *this;
+    }
+
+    auto resolve_sort_spec(const metadata &meta, const sort_spec &spec) -> sort_columns {
+      sort_columns ret;
+      ret.reserve(spec.size());
+      for(const auto &i : spec)
+        ret.push_back({meta.get_field_nr(i.field), i.order});
+      return ret;
+    }
+
+    context_common& context_common::sort(const sort_spec &spec) {
+      return sort(resolve_sort_spec(get_metadata(), spec));
+    }
+
+    context_common& context_common::stable_sort(const sort_spec &spec) {
+      return sort(resolve_sort_spec(get_metadata(), spec), true);
+    }
+
+    context_common& context_common::top_k(const sort_spec &spec, const size_t k) {
+      return top_k(resolve_sort_spec(get_metadata(), spec), k);
+    }
+
+    context_common& context_common::limit(const size_t n) {
+      if(rows().size() <= n)
+        return *this;
+      if(_sel_all) {
+        _sel.resize(n);
+        iota(_sel.begin(), _sel.end(), 0);
+        _sel_all = false;
+      } else {
+        _sel.resize(n);
+      }
       return *this;
     }
 
@@ -23,6 +60,16 @@ namespace zsdatab {
       return filter(get_field_nr(field), value, whole, neg);
     }
 
+    context_common& context_common::filter(const size_t field, const string& value, const bool whole, const bool neg, const size_t limit) {
+      if(limit == string::npos)
+        return filter(field, value, whole, neg);
+      return filter({{field, value, whole, neg}}, limit);
+    }
+
+    context_common& context_common::filter(const string& field, const string& value, const bool whole, const bool neg, const size_t limit) {
+      return filter(get_field_nr(field), value, whole, neg, limit);
+    }
+
     context_common& context_common::set_field(const size_t field, const string& value) {
       get_fixcol_proxy(field).set(value);
       return *this;
@@ -76,6 +123,10 @@ namespace zsdatab {
       return const_fixcol_proxy(*this, field).get(_uniq);
     }
 
+    auto context_common::count_distinct(const string &field) const -> size_t {
+      return const_fixcol_proxy(*this, field).count_distinct();
+    }
+
     fixcol_proxy context_common::get_fixcol_proxy(const size_t field) {
       return {*this, field};
     }
@@ -86,32 +137,53 @@ namespace zsdatab {
         throw invalid_argument(__PRETTY_FUNCTION__);
     }
 
+    // contexts and tables share their rows, other buffers are copied
     context_common& context_common::operator=(const context_common &o) {
-      return *this = static_cast<const buffer_interface&>(o);
+      if(this != &o) {
+        op_table_compat_chk(*this, o);
+        _base = o._base;
+        _sel = o._sel;
+        _sel_all = o._sel_all;
+      }
+      return *this;
+    }
+
+    context_common& context_common::operator=(const table_interface &o) {
+      op_table_compat_chk(*this, o);
+      _base = o.shared_rows();
+      _sel.clear();
+      _sel_all = true;
+      return *this;
     }
 
     context_common& context_common::operator=(const buffer_interface &o) {
       if(this != &o) {
         op_table_compat_chk(*this, o);
-        _buffer = o.data();
+        _base = share_rows(o.rows());
+        _sel.clear();
+        _sel_all = true;
       }
       return *this;
     }
 
     context_common& context_common::operator=(context_common &&o) {
       op_table_compat_chk(*this, o);
-      swap(_buffer, o._buffer);
+      swap_rows(o);
       return *this;
     }
 
     context_common& context_common::operator+=(const buffer_interface &o) {
       if(this != &o) {
         op_table_compat_chk(*this, o);
-        _buffer.reserve(_buffer.size() + o.data().size());
-        _buffer.insert(_buffer.end(), o.data().begin(), o.data().end());
+        auto &buf = own();
+        const auto v = o.rows();
+        buf.reserve(buf.size() + v.size());
+        for(size_t i = 0; i < v.size(); ++i)
+          buf.emplace_back(v.share(i));
       } else {
-        _buffer.reserve(_buffer.size() << 1);
-        copy_n(_buffer.begin(), _buffer.size(), back_inserter(_buffer)); // assuming no overflow
+        auto &buf = own();
+        buf.reserve(buf.size() << 1);
+        copy_n(buf.begin(), buf.size(), back_inserter(buf)); // assuming no overflow
       }
       return *this;
     }
@@ -119,7 +191,7 @@ namespace zsdatab {
     context_common& context_common::operator+=(const row_t &line) {
       if(line.size() != get_metadata().get_field_count())
         throw length_error(__PRETTY_FUNCTION__);
-      _buffer.push_back(line);
+      own().emplace_back(make_shared<row_t>(line));
       return *this;
     }
 
@@ -134,29 +206,32 @@ namespace zsdatab {
     bool operator==(const context_common &a, const context_common &b) noexcept {
       if(&a == &b) return true;
       const auto &am = a.get_metadata(), &bm = b.get_metadata();
-      return (&am == &bm || am.get_cols() == bm.get_cols())
-          && (a.data() == b.data());
+      if(&am != &bm && am.get_cols() != bm.get_cols())
+        return false;
+      const auto ra = a.rows(), rb = b.rows();
+      return ra.size() == rb.size() && equal(ra.begin(), ra.end(), rb.begin(),
+        [](const row_t &x, const row_t &y) noexcept { return &x == &y || x == y; });
     }
 
     ostream& operator<<(ostream& stream, const context_common &ctx) {
       if(!stream) return stream;
       auto &m = ctx.get_metadata();
-      for(auto &l : ctx.data())
+      for(auto &l : ctx.rows())
         stream << m.serialize(l) << '\n';
       return stream;
     }
 
     istream& operator>>(istream& stream, context_common& ctx) {
       if(!stream) return stream;
-      const auto m = ctx.get_metadata();
-      string tmp;
-      while(getline(stream, tmp))
-        ctx += m.deserialize(tmp);
+      // the lines are parsed in parallel
+      const string data = read_stream(stream);
+      const auto &meta = ctx.get_metadata();
+      ctx += make_table_ref(meta, make_shared<row_store>(parse_rows(meta, data.data(), data.size(), import_format::native, false)));
       return stream;
     }
   }
 
   // dunno where to put this one
   const_context::const_context(const context &o)
-    : context_base<const table>(o._table, o._buffer) { }
+    : context_base<const table>(o._table, static_cast<const context_common&>(o)) { }
 }
@@ -0,0 +1,82 @@
+/**********************************************
+ *  header: zsdatab::intern::hash_distinct
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+#pragma once
+#include "zsdatable.hpp"
+#include "pool.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <unordered_set>
+
+namespace zsdatab {
+  namespace intern {
+    [[gnu::hot]]
+    static inline size_t hash_row(const row_t &row) noexcept {
+      const std::hash<std::string> hs;
+      size_t ret = row.size();
+      for(const auto &i : row)
+        ret ^= hs(i) + 0x9e3779b97f4a7c15 + (ret << 6) + (ret >> 2);
+      return ret;
+    }
+
+    /* hash_distinct - mark the first occurrence of every distinct element
+     * @return : vector<char> : keep flags (keep[i] != 0 if element i is seen first)
+     *
+     * @param hashes : precomputed element hashes
+     * @param eq     : callable (i, j) -> bool, element equality
+     *
+     * NOTE: large inputs are split into shards by hash, which are processed in
+     *       parallel; every shard is scanned in index order, so the first-seen
+     *       element always wins
+     */
+    template<class Teq>
+    auto hash_distinct(const std::vector<size_t> &hashes, const Teq &eq) -> std::vector<char> {
+      const size_t n = hashes.size();
+      const unsigned shard_bits = (plan_parallel(par_op::distinct, n) > 1) ? 6 : 0;
+      const size_t shard_cnt = size_t(1) << shard_bits;
+      const auto shard_of = [&hashes, shard_bits](const size_t i) noexcept -> size_t {
+        return shard_bits ? (hashes[i] >> (8 * sizeof(size_t) - shard_bits)) : 0;
+      };
+
+      // stable counting sort of element indices into shards
+      std::vector<size_t> offsets(shard_cnt + 1, 0), order(n);
+      for(size_t i = 0; i < n; ++i) ++offsets[shard_of(i) + 1];
+      std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+      {
+        std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+        for(size_t i = 0; i < n; ++i) order[pos[shard_of(i)]++] = i;
+      }
+
+      std::vector<char> keep(n, 0);
+      run_chunks(shard_cnt, [&](const size_t s) {
+        const auto hf = [&hashes](const size_t i) noexcept { return hashes[i]; };
+        const auto ef = [&hashes, &eq](const size_t a, const size_t b) {
+          return hashes[a] == hashes[b] && eq(a, b);
+        };
+        const size_t sb = offsets[s], se = offsets[s + 1];
+        std::unordered_set<size_t, decltype(hf), decltype(ef)> seen(se - sb, hf, ef);
+        for(size_t j = sb; j < se; ++j)
+          keep[order[j]] = seen.insert(order[j]).second;
+      });
+
+      return keep;
+    }
+
+    // compact_kept - erase all elements of buf which aren't marked in keep, preserving order
+    template<class T>
+    void compact_kept(std::vector<T> &buf, const std::vector<char> &keep) {
+      size_t o = 0;
+      for(size_t i = 0; i < buf.size(); ++i) {
+        if(!keep[i]) continue;
+        if(o != i) buf[o] = std::move(buf[i]);
+        ++o;
+      }
+      buf.erase(buf.begin() + o, buf.end());
+    }
+  }
+}
@@ -6,8 +6,9 @@
  **********************************************/
 
 #include "zsdatable.hpp"
-#define ZSDA_PAR
-#include <config.h>
+#include "distinct.hpp"
+#include "pool.hpp"
+#include "mutation.hpp"
 
 #include <algorithm>
 
@@ -20,27 +21,51 @@ namespace zsdatab {
 
     auto fixcol_proxy_common::get(const bool _uniq) const -> vector<string> {
       vector<string> ret;
-      ret.reserve(_underlying_data().size());
-      for(const auto &i : _underlying_data())
+      const auto rows = _underlying_rows();
+      ret.reserve(rows.size());
+      for(const auto &i : rows)
         ret.emplace_back(i[_nr]);
 
-      if(_uniq && !ret.empty()) {
-        auto ie = ret.end();
-        sort(ZSDAM_PAR ret.begin(), ie);
-        ret.erase(unique(ZSDAM_PAR ret.begin(), ie), ie);
+      if(_uniq && ret.size() > 1) {
+        vector<size_t> hashes(ret.size());
+        parallel_for(par_op::distinct, ret.size(), [&ret, &hashes](const size_t from, const size_t to) noexcept {
+          const hash<string> hs;
+          for(size_t i = from; i < to; ++i)
+            hashes[i] = hs(ret[i]);
+        });
+        compact_kept(ret, hash_distinct(hashes, [&ret](const size_t a, const size_t b) noexcept {
+          return ret[a] == ret[b];
+        }));
       }
 
       return ret;
     }
 
+    auto fixcol_proxy_common::count_distinct() const -> size_t {
+      const auto rows = _underlying_rows();
+      const size_t n = rows.size();
+      if(n < 2) return n;
+
+      vector<size_t> hashes(n);
+      parallel_for(par_op::distinct, n, [this, &rows, &hashes](const size_t from, const size_t to) noexcept {
+        const hash<string> hs;
+        for(size_t i = from; i < to; ++i)
+          hashes[i] = hs(rows[i][_nr]);
+      });
+      const auto keep = hash_distinct(hashes, [this, &rows](const size_t a, const size_t b) noexcept {
+        return rows[a][_nr] == rows[b][_nr];
+      });
+      return count(keep.begin(), keep.end(), 1);
+    }
+
     fixcol_proxy::fixcol_proxy(context_common &uplink, const size_t nr)
       : fixcol_proxy_common(nr), _uplink(uplink) { }
 
     fixcol_proxy::fixcol_proxy(context_common &uplink, const string &field)
       : fixcol_proxy_common(uplink, field), _uplink(uplink) { }
 
-    auto fixcol_proxy::_underlying_data() const -> const buffer_t&
-      { return _uplink.data(); }
+    auto fixcol_proxy::_underlying_rows() const -> row_view
+      { return _uplink.rows(); }
 
     const_fixcol_proxy::const_fixcol_proxy(const buffer_interface &uplink, const size_t nr)
       : fixcol_proxy_common(nr), _uplink(uplink) { }
@@ -54,33 +79,26 @@ namespace zsdatab {
     // change
 
     fixcol_proxy& fixcol_proxy::set(const string &value) {
-      for(auto &l : _uplink._buffer) l[_nr] = value;
+      // unchanged rows stay shared
+      apply_column(mutation_kernel(_nr, mut_op::set, value), _uplink.own());
       return *this;
     }
 
     fixcol_proxy& fixcol_proxy::append(const string &value) {
-      for(auto &l : _uplink._buffer) l[_nr] += value;
+      if(!value.empty())
+        apply_column(mutation_kernel(_nr, mut_op::append, value), _uplink.own());
       return *this;
     }
 
     fixcol_proxy& fixcol_proxy::remove(const string &value) {
-      for(auto &l : _uplink._buffer) {
-        const auto pos = l[_nr].find(value);
-        if(pos != string::npos) l[_nr].erase(pos, value.length());
-      }
+      if(!value.empty())
+        apply_column(mutation_kernel(_nr, mut_op::remove_part, value), _uplink.own());
       return *this;
     }
 
     fixcol_proxy& fixcol_proxy::replace(const string& from, const string& to) {
-      if(from.empty()) return *this;
-
-      for_each(ZSDAC_PAR _uplink._buffer.begin(), _uplink._buffer.end(), [this, &from, &to](auto &l) noexcept {
-        size_t sp = 0;
-        while((sp = l[_nr].find(from, sp)) != string::npos) {
-          l[_nr].replace(sp, from.length(), to);
-          sp += to.length();
-        }
-      });
+      if(!from.empty() && from != to)
+        apply_column(mutation_kernel(_nr, mut_op::replace, from, to), _uplink.own());
       return *this;
     }
   }
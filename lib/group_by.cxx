@@ -0,0 +1,248 @@
+/**********************************************
+ *   class: zsdatab::group_by
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "zsdatable.hpp"
+#include "number.hpp"
+#include "pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+namespace zsdatab {
+  namespace {
+    struct agg_slot {
+      const string *ext = nullptr; // min/max
+      double sum = 0;
+      unordered_set<string_view> set;
+    };
+
+    struct agg_state {
+      size_t first, count;
+      vector<agg_slot> slots;
+    };
+
+    class agg_runner {
+      const row_view _buf;
+      const vector<size_t> &_cols;
+      const aggregate_spec &_aggs;
+      vector<size_t> _aggcols;
+
+     public:
+      agg_runner(const row_view &buf, const vector<size_t> &cols, const aggregate_spec &aggs, const metadata &meta)
+        : _buf(buf), _cols(cols), _aggs(aggs)
+      {
+        _aggcols.reserve(aggs.size());
+        for(const auto &i : aggs)
+          _aggcols.push_back((i.fn == agg::count) ? 0 : meta.get_field_nr(i.field));
+      }
+
+      struct key_hash {
+        const agg_runner &r;
+        size_t operator()(const size_t i) const noexcept {
+          const hash<string> hs;
+          size_t ret = 0;
+          for(const auto c : r._cols)
+            ret ^= hs(r._buf[i][c]) + 0x9e3779b97f4a7c15 + (ret << 6) + (ret >> 2);
+          return ret;
+        }
+      };
+
+      struct key_eq {
+        const agg_runner &r;
+        bool operator()(const size_t a, const size_t b) const noexcept {
+          const auto &ra = r._buf[a], &rb = r._buf[b];
+          for(const auto c : r._cols)
+            if(ra[c] != rb[c]) return false;
+          return true;
+        }
+      };
+
+      // group key = index of the first row of the group
+      typedef unordered_map<size_t, agg_state, key_hash, key_eq> partial_t;
+
+      partial_t make_partial() const {
+        return partial_t(16, key_hash{*this}, key_eq{*this});
+      }
+
+      void scan(partial_t &part, const size_t from, const size_t to) const {
+        const size_t ac = _aggs.size();
+        for(size_t i = from; i < to; ++i) {
+          auto it = part.find(i);
+          if(it == part.end()) {
+            it = part.emplace(i, agg_state{i, 0, vector<agg_slot>(ac)}).first;
+          }
+          auto &st = it->second;
+          ++st.count;
+          const auto &row = _buf[i];
+
+          for(size_t a = 0; a < ac; ++a) {
+            auto &sl = st.slots[a];
+            const string &v = row[_aggcols[a]];
+            switch(_aggs[a].fn) {
+              case agg::min:
+                if(!sl.ext || v < *sl.ext) sl.ext = &v;
+                break;
+              case agg::max:
+                if(!sl.ext || v > *sl.ext) sl.ext = &v;
+                break;
+              case agg::sum: {
+                double x;
+                if(intern::parse_decimal(v, x)) sl.sum += x;
+                break;
+              }
+              case agg::count_distinct:
+                sl.set.emplace(v);
+                break;
+              default:
+                break;
+            }
+          }
+        }
+      }
+
+      void merge(partial_t &dst, partial_t &&src) const {
+        const size_t ac = _aggs.size();
+        for(auto &i : src) {
+          auto it = dst.find(i.first);
+          if(it == dst.end()) {
+            dst.emplace(i.first, move(i.second));
+            continue;
+          }
+
+          auto &d = it->second, &s = i.second;
+          d.first = min(d.first, s.first);
+          d.count += s.count;
+          for(size_t a = 0; a < ac; ++a) {
+            auto &ds = d.slots[a], &ss = s.slots[a];
+            switch(_aggs[a].fn) {
+              case agg::min:
+                if(*ss.ext < *ds.ext) ds.ext = ss.ext;
+                break;
+              case agg::max:
+                if(*ss.ext > *ds.ext) ds.ext = ss.ext;
+                break;
+              case agg::sum:
+                ds.sum += ss.sum;
+                break;
+              case agg::count_distinct:
+                ds.set.merge(ss.set);
+                break;
+              default:
+                break;
+            }
+          }
+        }
+      }
+    };
+
+    string format_number(const double x) {
+      if(std::trunc(x) == x && std::fabs(x) < 9.2e18)
+        return to_string(static_cast<long long>(x));
+      char tmp[32];
+      snprintf(tmp, sizeof(tmp), "%.15g", x);
+      return tmp;
+    }
+
+    const char *agg_name(const agg fn) noexcept {
+      switch(fn) {
+        case agg::count:          return "count";
+        case agg::min:            return "min";
+        case agg::max:            return "max";
+        case agg::sum:            return "sum";
+        case agg::count_distinct: return "count_distinct";
+      }
+      return "";
+    }
+  }
+
+  group_by::group_by(const buffer_interface &src, const row_t &cols)
+    : _src(src)
+  {
+    const auto &meta = src.get_metadata();
+    _cols.reserve(cols.size());
+    for(const auto &i : cols)
+      _cols.push_back(meta.get_field_nr(i));
+  }
+
+  auto group_by::agg(const aggregate_spec &aggs) const -> table {
+    const auto &meta = _src.get_metadata();
+    const auto buf = _src.rows();
+    const agg_runner runner(buf, _cols, aggs, meta);
+
+    // per-chunk partial aggregation, merged in chunk order
+    const size_t n = buf.size();
+    const size_t chunks = max<size_t>(1, intern::plan_parallel(intern::par_op::group_by, n));
+    vector<agg_runner::partial_t> parts;
+    parts.reserve(chunks);
+    for(size_t i = 0; i < chunks; ++i)
+      parts.emplace_back(runner.make_partial());
+
+    if(chunks == 1) {
+      const auto start = intern::par_clock::now();
+      runner.scan(parts.front(), 0, n);
+      intern::record_sequential(intern::par_op::group_by, n, intern::par_clock::now() - start);
+    } else {
+      intern::record_parallel(intern::par_op::group_by);
+      intern::run_chunks(chunks, [&](const size_t c) {
+        runner.scan(parts[c], n * c / chunks, n * (c + 1) / chunks);
+      });
+    }
+
+    for(size_t i = 1; i < chunks; ++i)
+      runner.merge(parts.front(), move(parts[i]));
+
+    // build the result table
+    row_t cols;
+    cols.reserve(_cols.size() + aggs.size());
+    for(const auto i : _cols)
+      cols.emplace_back(meta.get_field_name(i));
+    for(const auto &i : aggs)
+      cols.emplace_back((i.fn == zsdatab::agg::count) ? string("count") : (string(agg_name(i.fn)) + '(' + i.field + ')'));
+
+    vector<const agg_state *> groups;
+    groups.reserve(parts.front().size());
+    for(const auto &i : parts.front())
+      groups.emplace_back(&i.second);
+    sort(groups.begin(), groups.end(), [](const agg_state *a, const agg_state *b) noexcept {
+      return a->first < b->first;
+    });
+
+    buffer_t ret;
+    ret.reserve(groups.size());
+    for(const auto g : groups) {
+      row_t line;
+      line.reserve(cols.size());
+      for(const auto i : _cols)
+        line.emplace_back(buf[g->first][i]);
+      for(size_t a = 0; a < aggs.size(); ++a) {
+        const auto &sl = g->slots[a];
+        switch(aggs[a].fn) {
+          case zsdatab::agg::count:          line.emplace_back(to_string(g->count));     break;
+          case zsdatab::agg::min:
+          case zsdatab::agg::max:            line.emplace_back(*sl.ext);                 break;
+          case zsdatab::agg::sum:            line.emplace_back(format_number(sl.sum));   break;
+          case zsdatab::agg::count_distinct: line.emplace_back(to_string(sl.set.size())); break;
+        }
+      }
+      ret.emplace_back(move(line));
+    }
+
+    return table(metadata(meta.separator(), move(cols)), move(ret));
+  }
+
+  namespace intern {
+    auto context_common::group_by(const row_t &cols) const -> zsdatab::group_by {
+      return {*this, cols};
+    }
+  }
+}
@@ -0,0 +1,402 @@
+/**********************************************
+ *    part: parse_rows, serialize_rows, table::import_rows
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "parse.hpp"
+#include "instrument.hpp"
+#include "pool.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+namespace zsdatab {
+  namespace intern {
+    void split_native(const char *p, const char *const end, const char sep, row_t &out) {
+      // like getline: a trailing separator doesn't start another field
+      while(p != end) {
+        const char *fe = static_cast<const char *>(memchr(p, sep, end - p));
+        if(!fe) fe = end;
+        out.emplace_back();
+        auto &col = out.back();
+        const char *bs = static_cast<const char *>(memchr(p, '\\', fe - p));
+        if(!bs) {
+          col.assign(p, fe);
+        } else {
+          col.reserve(fe - p);
+          col.append(p, bs);
+          for(p = bs; p != fe; ++p) {
+            if(*p != '\\') {
+              col += *p;
+              continue;
+            }
+            if(++p == fe) break;
+            switch(*p) {
+              case '-': break;
+              case 'd': col += sep; break;
+              case 'n': col += '\n'; break;
+              default:  col += *p;
+            }
+          }
+        }
+        p = (fe == end) ? end : (fe + 1);
+      }
+    }
+
+    [[gnu::hot]]
+    void join_native(const row_t &row, const char sep, string &out) {
+      bool fi = true;
+      for(const auto &i : row) {
+        if(!fi) out += sep;
+        fi = false;
+
+        if(i.empty()) {
+          out += "\\-";
+          continue;
+        }
+
+        for(auto c : i)
+          switch(c) {
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            default:
+              if(c == sep) out += "\\d";
+              else out += c;
+          }
+      }
+    }
+
+    namespace {
+      // split_tsv - tab separated fields with \t, \n, \r and \\ escapes
+      void split_tsv(const char *p, const char *end, row_t &out) {
+        if(p != end && end[-1] == '\r') --end;
+        for(;;) {
+          const char *fe = static_cast<const char *>(memchr(p, '\t', end - p));
+          if(!fe) fe = end;
+          out.emplace_back();
+          auto &col = out.back();
+          col.reserve(fe - p);
+          for(; p != fe; ++p) {
+            if(*p != '\\' || p + 1 == fe) {
+              col += *p;
+              continue;
+            }
+            switch(*++p) {
+              case 't': col += '\t'; break;
+              case 'n': col += '\n'; break;
+              case 'r': col += '\r'; break;
+              default:  col += *p;
+            }
+          }
+          if(fe == end) return;
+          p = fe + 1;
+        }
+      }
+
+      /* parse_csv_record - parse the CSV record at p
+       * @return : the start of the next record
+       */
+      auto parse_csv_record(const char *p, const char *const end, row_t &out) -> const char* {
+        for(;;) {
+          out.emplace_back();
+          auto &col = out.back();
+          if(p != end && *p == '"') {
+            for(++p; p != end; ++p) {
+              if(*p != '"') {
+                col += *p;
+              } else if(p + 1 != end && p[1] == '"') {
+                col += '"';
+                ++p;
+              } else {
+                ++p;
+                break;
+              }
+            }
+            // anything between the closing quote and the separator is kept as is
+            while(p != end && *p != ',' && *p != '\n' && *p != '\r')
+              col += *p++;
+          } else {
+            const char *fe = p;
+            while(fe != end && *fe != ',' && *fe != '\n' && *fe != '\r') ++fe;
+            col.assign(p, fe);
+            p = fe;
+          }
+
+          if(p == end) return end;
+          switch(*p) {
+            case ',':
+              ++p;
+              continue;
+            case '\r':
+              ++p;
+              if(p != end && *p == '\n') ++p;
+              return p;
+            default:
+              return p + 1;
+          }
+        }
+      }
+
+      /* skip_csv_record - the start of the record after the one at p
+       * (the grammar of parse_csv_record, without storing the fields)
+       */
+      auto skip_csv_record(const char *p, const char *const end) -> const char* {
+        for(;;) {
+          if(p != end && *p == '"') {
+            // "" is a quote inside of the field
+            do {
+              const char *q = static_cast<const char *>(memchr(p + 1, '"', end - p - 1));
+              p = q ? (q + 1) : end;
+            } while(p != end && *p == '"');
+          }
+          while(p != end && *p != ',' && *p != '\n' && *p != '\r') ++p;
+
+          if(p == end) return end;
+          switch(*p) {
+            case ',':
+              ++p;
+              continue;
+            case '\r':
+              ++p;
+              if(p != end && *p == '\n') ++p;
+              return p;
+            default:
+              return p + 1;
+          }
+        }
+      }
+
+      // next_line - the start of the line after the one at p
+      auto next_line(const char *p, const char *const end) -> const char* {
+        const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+        return nl ? (nl + 1) : end;
+      }
+
+      struct chunk_result {
+        row_store rows;
+        // start of the first invalid record (or nullptr)
+        const char *bad = nullptr;
+        size_t bad_fields = 0;
+      };
+
+      class row_parser final {
+        const metadata &_meta;
+        const import_format _fmt;
+        const bool _strict;
+        const size_t _cols;
+
+       public:
+        row_parser(const metadata &meta, const import_format fmt, const bool strict)
+          : _meta(meta), _fmt(fmt), _strict(strict), _cols(meta.get_field_count()) { }
+
+        auto format() const noexcept -> import_format
+          { return _fmt; }
+
+        // next_csv_record - the start of the record after the one at p, like parse
+        auto next_csv_record(const char *p, const char *const end) const -> const char* {
+          if(_strict && (*p == '\n' || *p == '\r')) return next_line(p, end);
+          return skip_csv_record(p, end);
+        }
+
+        void parse(const char *p, const char *const end, chunk_result &res) const {
+          const char sep = _meta.separator();
+          while(p != end) {
+            const char *const rec = p;
+            row_t row;
+            row.reserve(_cols);
+
+            if(_fmt == import_format::csv) {
+              if(_strict && (*p == '\n' || *p == '\r')) {
+                p = next_line(p, end);
+                continue;
+              }
+              p = parse_csv_record(p, end, row);
+            } else {
+              const char *le = static_cast<const char *>(memchr(p, '\n', end - p));
+              const char *const next = le ? (le + 1) : end;
+              if(!le) le = end;
+              if(_strict && (le == p || (le == p + 1 && *p == '\r'))) {
+                p = next;
+                continue;
+              }
+              if(_fmt == import_format::tsv) split_tsv(p, le, row);
+              else                           split_native(p, le, sep, row);
+              p = next;
+            }
+
+            if(row.size() != _cols) {
+              if(_strict) {
+                res.bad = rec;
+                res.bad_fields = row.size();
+                return;
+              }
+              row.resize(_cols);
+            }
+            res.rows.emplace_back(make_shared<row_t>(move(row)));
+          }
+        }
+      };
+
+      /* chunk_bounds - split data at record starts into about chunks parts
+       * CSV records are walked from the start (quoted fields may contain newlines,
+       * the quote state can't be told in the middle of the data)
+       */
+      auto chunk_bounds(const row_parser &parser, const char *const data, const size_t n, const size_t chunks) -> vector<const char*> {
+        const char *const end = data + n;
+        vector<const char*> ret{data};
+        ret.reserve(chunks + 1);
+        // CSV: start of the next record
+        const char *pos = data;
+
+        for(size_t c = 1; c < chunks; ++c) {
+          const char *p = data + n * c / chunks;
+          if(p <= ret.back()) continue;
+          if(parser.format() != import_format::csv) {
+            p = next_line(p - 1, end);
+          } else {
+            while(pos < p) pos = parser.next_csv_record(pos, end);
+            p = pos;
+          }
+          if(p == end) break;
+          if(p != ret.back()) ret.push_back(p);
+        }
+        ret.push_back(end);
+        return ret;
+      }
+    }
+
+    auto parse_rows(const metadata &meta, const char *data, const size_t n, const import_format fmt, const bool strict) -> row_store {
+      const row_parser parser(meta, fmt, strict);
+      op_timer t(event_type::parse);
+      t.bytes(n);
+      const size_t chunks = plan_parallel(par_op::import, n);
+      if(!chunks) return {};
+
+      vector<chunk_result> res;
+      if(chunks == 1) {
+        res.resize(1);
+        const auto start = par_clock::now();
+        parser.parse(data, data + n, res.front());
+        record_sequential(par_op::import, n, par_clock::now() - start);
+      } else {
+        const auto bounds = chunk_bounds(parser, data, n, chunks);
+        res.resize(bounds.size() - 1);
+        record_parallel(par_op::import);
+        run_chunks(res.size(), [&](const size_t c) {
+          parser.parse(bounds[c], bounds[c + 1], res[c]);
+        });
+      }
+
+      size_t total = 0;
+      for(const auto &i : res) {
+        if(i.bad) {
+          throw import_error("line " + to_string(count(data, i.bad, '\n') + 1)
+            + ": expected " + to_string(meta.get_field_count())
+            + " fields, got " + to_string(i.bad_fields));
+        }
+        total += i.rows.size();
+      }
+      t.rows_out(total);
+
+      if(res.size() == 1) return move(res.front().rows);
+      row_store ret;
+      ret.reserve(total);
+      for(auto &i : res)
+        ret.insert(ret.end(), make_move_iterator(i.rows.begin()), make_move_iterator(i.rows.end()));
+      return ret;
+    }
+
+    auto serialize_rows(const metadata &meta, const row_view &rows) -> string {
+      const size_t n = rows.size(), cols = meta.get_field_count();
+      const char sep = meta.separator();
+      const auto ser = [&rows, cols, sep](const size_t b, const size_t e, string &out) {
+        for(size_t i = b; i < e; ++i) {
+          const auto &r = rows[i];
+          if(r.size() != cols)
+            throw length_error(__PRETTY_FUNCTION__);
+          join_native(r, sep, out);
+          out += '\n';
+        }
+      };
+
+      const size_t chunks = plan_parallel(par_op::serialize, n);
+      string ret;
+      if(chunks <= 1) {
+        const auto start = par_clock::now();
+        ser(0, n, ret);
+        record_sequential(par_op::serialize, n, par_clock::now() - start);
+        return ret;
+      }
+
+      vector<string> parts(chunks);
+      record_parallel(par_op::serialize);
+      run_chunks(chunks, [&](const size_t c) {
+        ser(n * c / chunks, n * (c + 1) / chunks, parts[c]);
+      });
+      size_t len = 0;
+      for(const auto &i : parts) len += i.size();
+      ret.reserve(len);
+      for(const auto &i : parts) ret += i;
+      return ret;
+    }
+
+    auto read_stream(istream &in) -> string {
+      string ret;
+      char buf[0x10000];
+      while(in.read(buf, sizeof(buf)) || in.gcount())
+        ret.append(buf, in.gcount());
+      return ret;
+    }
+  }
+
+  auto table::import_rows(istream &in, const import_options &opts) -> size_t {
+    return import_rows(intern::read_stream(in), opts);
+  }
+
+  auto table::import_rows(const string &data, const import_options &opts) -> size_t {
+    const auto &meta = get_metadata();
+    vector<size_t> keys;
+    keys.reserve(opts.key.size());
+    for(const auto &i : opts.key)
+      keys.push_back(meta.get_field_nr(i));
+
+    auto rows = intern::parse_rows(meta, data.data(), data.size(), opts.format, true);
+    if(rows.empty()) return 0;
+
+    const auto cur = shared_rows();
+    auto store = make_shared<row_store>();
+    store->reserve(cur->size() + rows.size());
+    store->assign(cur->begin(), cur->end());
+
+    if(keys.empty()) {
+      store->insert(store->end(), rows.begin(), rows.end());
+    } else {
+      // key fields, length-prefixed (unambiguous)
+      const auto make_key = [&keys](const row_t &r) {
+        string ret;
+        for(const auto i : keys)
+          ret.append(to_string(r[i].size())).append(1, ':').append(r[i]);
+        return ret;
+      };
+
+      unordered_map<string, size_t> pos;
+      pos.reserve(store->size() + rows.size());
+      for(size_t i = 0; i < store->size(); ++i)
+        pos.emplace(make_key(*(*store)[i]), i);
+      for(auto &i : rows) {
+        const auto it = pos.emplace(make_key(*i), store->size());
+        if(it.second) store->emplace_back(move(i));
+        else          (*store)[it.first->second] = move(i);
+      }
+    }
+
+    const size_t ret = rows.size();
+    shared_rows(move(store));
+    return ret;
+  }
+}
@@ -0,0 +1,113 @@
+/**********************************************
+ *  object: zsdatab::intern::emit
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "instrument.hpp"
+
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+namespace zsdatab {
+  namespace intern {
+    namespace {
+      struct counter_state {
+        atomic<uint64_t> table_opens{0}, lock_wait_ns{0}, rows_loaded{0};
+        atomic<uint64_t> parses{0}, bytes_parsed{0}, parse_ns{0};
+        atomic<uint64_t> filters{0}, filter_ns{0}, sorts{0}, sort_ns{0}, joins{0}, join_ns{0};
+        atomic<uint64_t> write_backs{0}, bytes_written{0}, write_back_ns{0};
+      };
+
+      struct sink_state {
+        mutex mtx;
+        shared_ptr<event_sink> sink;
+        // checked without the lock, so events without a sink cost one load
+        atomic<bool> installed{false};
+      };
+
+      counter_state cnt;
+      sink_state snk;
+
+      inline void add(atomic<uint64_t> &c, const uint64_t n) noexcept {
+        c.fetch_add(n, memory_order_relaxed);
+      }
+    }
+
+    void emit(const event &ev) noexcept {
+      const uint64_t ns = ev.duration.count();
+      switch(ev.type) {
+        case event_type::table_open:
+          add(cnt.table_opens, 1);
+          add(cnt.lock_wait_ns, ns);
+          add(cnt.rows_loaded, ev.rows_out);
+          break;
+        case event_type::parse:
+          add(cnt.parses, 1);
+          add(cnt.bytes_parsed, ev.bytes);
+          add(cnt.parse_ns, ns);
+          break;
+        case event_type::filter:
+          add(cnt.filters, 1);
+          add(cnt.filter_ns, ns);
+          break;
+        case event_type::sort:
+          add(cnt.sorts, 1);
+          add(cnt.sort_ns, ns);
+          break;
+        case event_type::join:
+          add(cnt.joins, 1);
+          add(cnt.join_ns, ns);
+          break;
+        case event_type::write_back:
+          add(cnt.write_backs, 1);
+          add(cnt.bytes_written, ev.bytes);
+          add(cnt.write_back_ns, ns);
+          break;
+      }
+
+      if(!snk.installed.load(memory_order_acquire)) return;
+      shared_ptr<event_sink> sink;
+      {
+        lock_guard<mutex> lock(snk.mtx);
+        sink = snk.sink;
+      }
+      if(sink) sink->on_event(ev);
+    }
+  }
+
+  void set_event_sink(shared_ptr<event_sink> sink) {
+    auto &st = intern::snk;
+    lock_guard<mutex> lock(st.mtx);
+    st.installed.store(static_cast<bool>(sink), memory_order_release);
+    st.sink = move(sink);
+  }
+
+  auto get_event_sink() -> shared_ptr<event_sink> {
+    auto &st = intern::snk;
+    lock_guard<mutex> lock(st.mtx);
+    return st.sink;
+  }
+
+  auto get_counters() noexcept -> counters {
+    const auto &c = intern::cnt;
+    const auto ld = [](const atomic<uint64_t> &x) noexcept { return x.load(memory_order_relaxed); };
+    return {
+      ld(c.table_opens), ld(c.lock_wait_ns), ld(c.rows_loaded),
+      ld(c.parses), ld(c.bytes_parsed), ld(c.parse_ns),
+      ld(c.filters), ld(c.filter_ns), ld(c.sorts), ld(c.sort_ns), ld(c.joins), ld(c.join_ns),
+      ld(c.write_backs), ld(c.bytes_written), ld(c.write_back_ns)
+    };
+  }
+
+  void reset_counters() noexcept {
+    auto &c = intern::cnt;
+    for(auto i : {&c.table_opens, &c.lock_wait_ns, &c.rows_loaded, &c.parses, &c.bytes_parsed, &c.parse_ns,
+                  &c.filters, &c.filter_ns, &c.sorts, &c.sort_ns, &c.joins, &c.join_ns,
+                  &c.write_backs, &c.bytes_written, &c.write_back_ns})
+      i->store(0, memory_order_relaxed);
+  }
+}
@@ -0,0 +1,53 @@
+/**********************************************
+ *  header: zsdatab::intern::op_timer
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+#pragma once
+#include "zsdatable.hpp"
+#include "trace.hpp"
+#include <chrono>
+
+namespace zsdatab {
+  namespace intern {
+    // emit - add ev to the counters and pass it to the sink (if any)
+    void emit(const event &ev) noexcept;
+
+    inline const char *event_name(const event_type t) noexcept {
+      switch(t) {
+        case event_type::table_open: return "table_open";
+        case event_type::parse:      return "parse";
+        case event_type::filter:     return "filter";
+        case event_type::sort:       return "sort";
+        case event_type::join:       return "join";
+        case event_type::write_back: return "write_back";
+      }
+      return "";
+    }
+
+    // op_timer - reports (and traces) an operation when it goes out of scope
+    class op_timer final {
+      event _ev;
+      const std::chrono::steady_clock::time_point _start;
+
+     public:
+      explicit op_timer(const event_type t, const size_t rows_in = 0) noexcept
+        : _ev{t, {}, rows_in, 0, 0}, _start(std::chrono::steady_clock::now()) { }
+
+      ~op_timer() noexcept {
+        const auto end = std::chrono::steady_clock::now();
+        _ev.duration = end - _start;
+        emit(_ev);
+        if(tracing())
+          trace_span("op", event_name(_ev.type), _start, end,
+                     {"rows_in", _ev.rows_in}, {"rows_out", _ev.rows_out}, {"bytes", _ev.bytes});
+      }
+
+      void rows_out(const size_t n) noexcept
+        { _ev.rows_out = n; }
+      void bytes(const size_t n) noexcept
+        { _ev.bytes = n; }
+    };
+  }
+}
@@ -6,6 +6,7 @@
  **********************************************/
 
 #include "zsdatable.hpp"
+#include "instrument.hpp"
 #include <algorithm>
 
 zsdatab::table zsdatab::inner_join(const char sep, const buffer_interface &a, const buffer_interface &b) {
@@ -21,6 +22,7 @@ zsdatab::table zsdatab::inner_join(const char sep, const buffer_interface &a, co
   const metadata &ma = a.get_metadata();
   const metadata &mb = b.get_metadata();
   metadata mt(sep);
+  intern::op_timer t(event_type::join, a.rows().size() + b.rows().size());
 
   using namespace std;
   // compute column names
@@ -56,8 +58,8 @@ zsdatab::table zsdatab::inner_join(const char sep, const buffer_interface &a, co
   // compute table
   vector<vector<string>> table_data;
 
-  for(const auto &x : a.data())
-    for(const auto &y : b.data()) {
+  for(const auto &x : a.rows())
+    for(const auto &y : b.rows()) {
       vector<string> line(mt.get_field_count());
       bool match = true;
 
@@ -83,5 +85,6 @@ zsdatab::table zsdatab::inner_join(const char sep, const buffer_interface &a, co
       if(match) table_data.emplace_back(move(line));
     }
 
+  t.rows_out(table_data.size());
   return table(move(mt), move(table_data));
 }
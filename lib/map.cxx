@@ -21,6 +21,6 @@ namespace zsdatab {
       tmp.emplace_back(it != mappings.end() ? string(move(it->second)) : string(i));
     }
 
-    return intern::make_table_data_ref(metadata(mo.separator(), move(tmp)), in.data());
+    return intern::make_table_data_ref(metadata(mo.separator(), move(tmp)), intern::share_rows(in.rows()));
   }
 }
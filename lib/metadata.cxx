@@ -6,69 +6,14 @@
  **********************************************/
 
 #include "zsdatable.hpp"
+#include "parse.hpp"
 #include <algorithm>
 #include <iterator>
 #include <stdexcept>
-#include <sstream>
 
 using namespace std;
 
 namespace zsdatab {
-  [[gnu::hot]]
-  static auto deserialize_line(const string &line, const char my_sep) {
-    row_t ret;
-    string col;
-    istringstream ss(line);
-    while(getline(ss, col, my_sep)) {
-      bool escape = false;
-      string col2;
-      for(auto c : col) {
-        if(escape) {
-          escape = false;
-          switch(c) {
-            case '-': c = 0; break;
-            case 'd': c = my_sep; break;
-            case 'n': c = '\n'; break;
-          }
-          if(c) col2 += c;
-        } else {
-          // default mode
-          if(c == '\\') escape = true;
-          else col2 += c;
-        }
-      }
-      ret.emplace_back(move(col2));
-    }
-    return ret;
-  }
-
-  [[gnu::hot]]
-  static auto serialize_line(const row_t &cols, const char my_sep) {
-    string ret;
-    bool fi = true;
-
-    for(const auto &i : cols) {
-      if(!fi) ret += my_sep;
-      fi = false;
-
-      if(i.empty()) {
-        ret += "\\-";
-        continue;
-      }
-
-      for(auto c : i)
-        switch(c) {
-          case '\\': ret += "\\\\"; break;
-          case '\n': ret += "\\n"; break;
-          default:
-            if(c == my_sep) ret += "\\d";
-            else ret += c;
-        }
-    }
-
-    return ret;
-  }
-
   class metadata::impl final {
    public:
     row_t cols;
@@ -153,7 +98,9 @@ namespace zsdatab {
   }
 
   auto metadata::deserialize(const string &line) const -> row_t {
-    auto ret = deserialize_line(line, _d->sep);
+    row_t ret;
+    ret.reserve(_d->cols.size());
+    intern::split_native(line.data(), line.data() + line.size(), _d->sep, ret);
     ret.resize(_d->cols.size());
     return ret;
   }
@@ -161,11 +108,15 @@ namespace zsdatab {
   auto metadata::serialize(const row_t &line) const -> string {
     if(line.size() != _d->cols.size())
       throw length_error(__PRETTY_FUNCTION__);
-    return serialize_line(line, _d->sep);
+    string ret;
+    intern::join_native(line, _d->sep, ret);
+    return ret;
   }
 
   auto operator<<(ostream &stream, const metadata::impl &meta) -> ostream& {
-    stream << meta.sep << serialize_line(meta.cols, meta.sep) << '\n';
+    string tmp;
+    intern::join_native(meta.cols, meta.sep, tmp);
+    stream << meta.sep << tmp << '\n';
     return stream;
   }
 
@@ -178,7 +129,8 @@ namespace zsdatab {
     if(!old_layout) stream.unget();
     getline(stream, tmp);
 
-    meta.cols = deserialize_line(tmp, old_layout ? ' ' : meta.sep);
+    meta.cols.clear();
+    intern::split_native(tmp.data(), tmp.data() + tmp.size(), old_layout ? ' ' : meta.sep, meta.cols);
     return stream;
   }
 
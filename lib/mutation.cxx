@@ -0,0 +1,115 @@
+/**********************************************
+ *   class: zsdatab::intern::mutation_kernel
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "mutation.hpp"
+#include "pool.hpp"
+#include "table/common.hpp"
+
+using namespace std;
+
+namespace zsdatab {
+  namespace intern {
+    mutation_kernel::mutation_kernel(const size_t field, const mut_op op, string value, string to)
+      : _op(op), _field(field), _value(move(value)), _to(move(to)),
+        _srch((op == mut_op::remove_part || op == mut_op::replace) ? _value : string()) { }
+
+    mutation_kernel::mutation_kernel(const metadata &meta, const mutation &m)
+      : mutation_kernel(meta.get_field_nr(m.field), m.op, m.value, m.to) { }
+
+    bool mutation_kernel::transform(const string &f, string &out) const {
+      switch(_op) {
+        case mut_op::set:
+          if(f == _value) return false;
+          out = _value;
+          return true;
+
+        case mut_op::append:
+          if(_value.empty()) return false;
+          out.reserve(f.size() + _value.size());
+          out.append(f).append(_value);
+          return true;
+
+        case mut_op::remove_part:
+          {
+            if(_value.empty()) return false;
+            const size_t pos = _srch.find(f);
+            if(pos == string::npos) return false;
+            out.reserve(f.size() - _value.size());
+            out.append(f, 0, pos).append(f, pos + _value.size(), string::npos);
+          }
+          return true;
+
+        case mut_op::replace:
+          {
+            if(_value.empty() || _value == _to) return false;
+            size_t pos = _srch.find(f);
+            if(pos == string::npos) return false;
+
+            // growing replacements need the match count for the exact size
+            size_t len = f.size();
+            if(_to.size() > _value.size()) {
+              for(size_t p = pos; p != string::npos; p = _srch.find(f, p + _value.size()))
+                len += _to.size() - _value.size();
+            }
+            out.reserve(len);
+
+            size_t last = 0;
+            do {
+              out.append(f, last, pos - last).append(_to);
+              last = pos + _value.size();
+            } while((pos = _srch.find(f, last)) != string::npos);
+            out.append(f, last, string::npos);
+          }
+          return true;
+      }
+      return false;
+    }
+
+    auto compile_mutations(const metadata &meta, const mutation_spec &muts) -> mutation_kernels {
+      mutation_kernels ret;
+      ret.reserve(muts.size());
+      for(const auto &i : muts)
+        ret.emplace_back(meta, i);
+      return ret;
+    }
+
+    bool apply_mutation(const mutation_kernel &k, row_ptr &p) {
+      const size_t field = k.field();
+      string nv;
+      if(!k.transform((*p)[field], nv)) return false;
+
+      if(p.use_count() == 1 && !in_parallel_chunk()) {
+        // row_ptr's always point to non-const rows
+        const_cast<row_t&>(*p)[field].swap(nv);
+      } else {
+        // don't copy the old value
+        auto nr = make_shared<row_t>();
+        nr->reserve(p->size());
+        for(size_t i = 0; i < p->size(); ++i) {
+          if(i == field) nr->emplace_back(move(nv));
+          else           nr->emplace_back((*p)[i]);
+        }
+        p = move(nr);
+      }
+      return true;
+    }
+
+    bool apply_mutations(const mutation_kernels &ks, row_ptr &p) {
+      bool ret = false;
+      for(const auto &k : ks)
+        ret |= apply_mutation(k, p);
+      return ret;
+    }
+
+    void apply_column(const mutation_kernel &k, row_store &st) {
+      parallel_for(par_op::fixcol, st.size(), [&k, &st](const size_t b, const size_t e) {
+        for(size_t i = b; i < e; ++i)
+          apply_mutation(k, st[i]);
+      });
+    }
+  }
+}
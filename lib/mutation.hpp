@@ -0,0 +1,51 @@
+/**********************************************
+ *  header: zsdatab::intern::mutation_kernel
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+#pragma once
+#include "zsdatable.hpp"
+#include "strsearch.hpp"
+
+namespace zsdatab {
+  namespace intern {
+    // mutation_kernel - mutation resolved against metadata
+    class mutation_kernel final {
+     public:
+      mutation_kernel(const size_t field, const mut_op op, std::string value, std::string to = {});
+      // this function may throw an out_of_range exception if the field isn't found
+      mutation_kernel(const metadata &meta, const mutation &m);
+
+      auto field() const noexcept -> size_t
+        { return _field; }
+
+      /* transform - compute the new value of field f
+       * out gets exactly the needed capacity, replace runs in a single pass
+       * @return : false if the value doesn't change (out is untouched then)
+       */
+      bool transform(const std::string &f, std::string &out) const;
+
+     private:
+      mut_op _op;
+      size_t _field;
+      std::string _value, _to;
+      substring_searcher _srch;
+    };
+
+    typedef std::vector<mutation_kernel> mutation_kernels;
+
+    auto compile_mutations(const metadata &meta, const mutation_spec &muts) -> mutation_kernels;
+
+    /* apply_mutation(s) - apply kernel(s) to the row
+     * a shared row is copied on write, with the new value moved into the copy;
+     * in parallel chunks rows are always copied (a store may hold the same row twice)
+     * @return : true if the row was changed
+     */
+    bool apply_mutation(const mutation_kernel &k, row_ptr &p);
+    bool apply_mutations(const mutation_kernels &ks, row_ptr &p);
+
+    // apply_column - apply k to all rows of st (in parallel)
+    void apply_column(const mutation_kernel &k, row_store &st);
+  }
+}
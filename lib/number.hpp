@@ -0,0 +1,53 @@
+/**********************************************
+ *  header: zsdatab::intern::parse_decimal
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+#pragma once
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+
+namespace zsdatab {
+  namespace intern {
+    /* parse_decimal - parse a plain decimal number
+     * @return : bool : false if s isn't a number (ret is unchanged then)
+     *
+     * grammar: [+-] DIGITS [. DIGITS] [(e|E) [+-] DIGITS], the digits in front of
+     *          or after the point may be missing (not both);
+     *          no whitespace, hex numbers, inf or nan (unlike strtod);
+     *          numbers beyond the range of double aren't accepted either
+     */
+    [[gnu::hot]]
+    inline bool parse_decimal(const std::string &s, double &ret) noexcept {
+      const auto digits = [](const char *&p) noexcept -> bool {
+        const char *const b = p;
+        while(isdigit(static_cast<unsigned char>(*p))) ++p;
+        return p != b;
+      };
+
+      const char *p = s.c_str();
+      if(*p == '+' || *p == '-') ++p;
+      bool mant = digits(p);
+      if(*p == '.') {
+        ++p;
+        mant = digits(p) || mant;
+      }
+      if(!mant) return false;
+      if(*p == 'e' || *p == 'E') {
+        ++p;
+        if(*p == '+' || *p == '-') ++p;
+        if(!digits(p)) return false;
+      }
+      // embedded NULs aren't numbers either
+      if(p != s.c_str() + s.size()) return false;
+
+      const double x = strtod(s.c_str(), nullptr);
+      if(isinf(x)) return false;
+      ret = x;
+      return true;
+    }
+  }
+}
@@ -0,0 +1,33 @@
+/**********************************************
+ *  header: zsdatab::intern::parse_rows
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+#pragma once
+#include "zsdatable.hpp"
+
+namespace zsdatab {
+  namespace intern {
+    // split_native - split a line in the table format into (unescaped) fields
+    void split_native(const char *p, const char *const end, const char sep, row_t &out);
+    // join_native - append the (escaped) fields in the table format to out
+    void join_native(const row_t &row, const char sep, std::string &out);
+
+    /* parse_rows - parse all records of data, in parallel
+     * strict  : every record must have one field per column (import_error otherwise),
+     *           empty lines are skipped
+     * !strict : like reading a table file (missing fields are empty, extra fields are
+     *           dropped, empty lines are rows of empty fields)
+     */
+    auto parse_rows(const metadata &meta, const char *data, const size_t n, const import_format fmt, const bool strict) -> row_store;
+
+    /* serialize_rows - rows in the table format (one line per row), in parallel
+     * this function may throw a length_error if a row doesn't match the metadata
+     */
+    auto serialize_rows(const metadata &meta, const row_view &rows) -> std::string;
+
+    // read_stream - read the rest of in
+    auto read_stream(std::istream &in) -> std::string;
+  }
+}
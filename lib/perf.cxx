@@ -0,0 +1,175 @@
+/**********************************************
+ *  object: zsdatab::enable_hw_counters
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "perf.hpp"
+
+#include <unistd.h>
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+# include <linux/perf_event.h>
+# include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+namespace zsdatab {
+  namespace intern {
+    atomic<bool> hw_enabled{false};
+
+    namespace {
+      constexpr size_t hw_events = 4;
+
+      // group - the counters of one thread, fds[0] is the group leader
+      struct group {
+        int fds[hw_events];
+      };
+
+      // retired - the final counts of the exited threads
+      struct hw_state {
+        mutex mtx;
+        vector<group> groups;
+        hw_counters retired;
+        bool unavailable = false;
+      };
+
+      hw_state &get_hw() {
+        static hw_state ret;
+        return ret;
+      }
+
+      void read_group(const group &g, hw_counters &ret) noexcept;
+
+      // attachment - the counters of this thread are closed when it exits
+      struct attachment {
+        bool tried = false, open = false;
+        group g;
+
+        ~attachment() {
+          if(!open) return;
+          auto &st = get_hw();
+          lock_guard<mutex> lock(st.mtx);
+          read_group(g, st.retired);
+          for(auto it = st.groups.begin(); it != st.groups.end(); ++it)
+            if(it->fds[0] == g.fds[0]) {
+              st.groups.erase(it);
+              break;
+            }
+          for(const auto i : g.fds) close(i);
+        }
+      };
+
+      thread_local attachment attached;
+
+      // open_group - open the counters of the calling thread
+      bool open_group(group &g) noexcept {
+#ifdef __linux__
+        static const uint64_t config[hw_events] = {
+          PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+          PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for(size_t i = 0; i < hw_events; ++i) {
+          perf_event_attr attr = {};
+          attr.size = sizeof(attr);
+          attr.type = PERF_TYPE_HARDWARE;
+          attr.config = config[i];
+          attr.exclude_kernel = 1;
+          attr.exclude_hv = 1;
+          attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+          g.fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i ? g.fds[0] : -1, PERF_FLAG_FD_CLOEXEC);
+          if(g.fds[i] < 0) {
+            while(i) close(g.fds[--i]);
+            return false;
+          }
+        }
+        return true;
+#else
+        (void) g;
+        return false;
+#endif
+      }
+
+      // read_group - add the (scaled, if multiplexed) counts of g to ret
+      void read_group(const group &g, hw_counters &ret) noexcept {
+#ifdef __linux__
+        struct {
+          uint64_t nr, enabled, running, values[hw_events];
+        } buf;
+        if(read(g.fds[0], &buf, sizeof(buf)) != sizeof(buf) || buf.nr != hw_events || !buf.running)
+          return;
+        const double scale = static_cast<double>(buf.enabled) / buf.running;
+        const auto val = [&](const size_t i) { return static_cast<uint64_t>(buf.values[i] * scale); };
+        ret.cycles += val(0);
+        ret.instructions += val(1);
+        ret.cache_misses += val(2);
+        ret.branch_misses += val(3);
+#else
+        (void) g;
+        (void) ret;
+#endif
+      }
+
+      // attach - st.mtx must be locked
+      bool attach(hw_state &st) noexcept {
+        if(attached.open) return true;
+        attached.tried = true;
+        auto &g = attached.g;
+        if(!open_group(g)) return false;
+        try {
+          st.groups.push_back(g);
+        } catch(...) {
+          for(const auto i : g.fds) close(i);
+          return false;
+        }
+        attached.open = true;
+        return true;
+      }
+    }
+
+    void hw_attach_thread() noexcept {
+      // don't retry on every task if it fails
+      if(attached.tried) return;
+      auto &st = get_hw();
+      lock_guard<mutex> lock(st.mtx);
+      attach(st);
+    }
+
+    auto hw_delta(const hw_counters &a, const hw_counters &b) noexcept -> hw_counters {
+      if(!a.valid || !b.valid) return {};
+      // scaled (multiplexed) counts can go back a bit
+      const auto sub = [](const uint64_t x, const uint64_t y) { return (x > y) ? (x - y) : 0; };
+      return {true, sub(a.cycles, b.cycles), sub(a.instructions, b.instructions),
+              sub(a.cache_misses, b.cache_misses), sub(a.branch_misses, b.branch_misses)};
+    }
+  }
+
+  bool enable_hw_counters() noexcept {
+    auto &st = intern::get_hw();
+    lock_guard<mutex> lock(st.mtx);
+    if(st.unavailable) return false;
+    if(!intern::attach(st)) {
+      // the first thread decides
+      if(st.groups.empty()) st.unavailable = true;
+      return false;
+    }
+    intern::hw_enabled.store(true);
+    return true;
+  }
+
+  auto read_hw_counters() noexcept -> hw_counters {
+    hw_counters ret;
+    if(!intern::hw_enabled.load()) return ret;
+    auto &st = intern::get_hw();
+    lock_guard<mutex> lock(st.mtx);
+    ret = st.retired;
+    for(const auto &i : st.groups)
+      intern::read_group(i, ret);
+    ret.valid = true;
+    return ret;
+  }
+}
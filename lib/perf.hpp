@@ -0,0 +1,27 @@
+/**********************************************
+ *  header: zsdatab::intern::hw_attach
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+#pragma once
+#include "zsdatable.hpp"
+#include <atomic>
+
+namespace zsdatab {
+  namespace intern {
+    // set by enable_hw_counters
+    extern std::atomic<bool> hw_enabled;
+
+    void hw_attach_thread() noexcept;
+
+    // hw_attach - count the current thread too (if the counters are enabled)
+    inline void hw_attach() noexcept {
+      if(hw_enabled.load(std::memory_order_relaxed))
+        hw_attach_thread();
+    }
+
+    // hw_delta - a - b (invalid if one of them is invalid)
+    auto hw_delta(const hw_counters &a, const hw_counters &b) noexcept -> hw_counters;
+  }
+}
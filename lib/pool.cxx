@@ -1,16 +1,214 @@
 /**********************************************
- *  object: zsdatab::intern::threadpool
+ *  object: zsdatab::intern::run_chunks
  * library: zsdatable
  * package: zsdatab
  * SPDX-License-Identifier: LGPL-2.1-or-later
  **********************************************/
 
 #include "pool.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+
+using namespace std;
 
-#ifndef HAVE_CXXH_EXECUTION
 namespace zsdatab {
   namespace intern {
-    ThreadPool threadpool(std::thread::hardware_concurrency());
+    namespace {
+      // set while the current thread runs a chunk
+      thread_local bool in_chunk = false;
+      // trace name of the chunks of the next run_chunks, set by record_parallel
+      thread_local const char *chunk_name = "chunk";
+
+      class chunk_guard final {
+        const bool _old;
+
+       public:
+        chunk_guard() noexcept : _old(in_chunk) { in_chunk = true; }
+        ~chunk_guard() { in_chunk = _old; }
+      };
+
+      class error_slot final {
+        mutex _mtx;
+        exception_ptr _ex;
+
+       public:
+        void set(exception_ptr ex) {
+          lock_guard<mutex> lock(_mtx);
+          if(!_ex) _ex = move(ex);
+        }
+
+        void rethrow() {
+          if(_ex) rethrow_exception(_ex);
+        }
+      };
+
+      // estimated cost of waking the workers and joining them
+      constexpr double par_overhead_ns = 50000;
+      // minimal work per chunk
+      constexpr double min_chunk_ns = 25000;
+
+      struct op_model {
+        const char *name;
+        // minimal elements per chunk (e.g. if chunks have to be merged)
+        size_t min_grain;
+        // cost per element, calibrated on sequential runs
+        atomic<double> cost_ns;
+        // 0 = use the cost model
+        atomic<size_t> threshold;
+        atomic<size_t> seq_runs, par_runs;
+      };
+
+      class op_models final {
+        op_model _ops[par_op_count] = {
+          {"filter",   0x400,  15, 0, 0, 0},
+          {"negate",   0x400,  50, 0, 0, 0},
+          {"uniq",     0x400,  10, 0, 0, 0},
+          {"distinct", 0x400,  40, 0, 0, 0},
+          {"sort",     0x400, 150, 0, 0, 0},
+          {"group_by", 0x4000, 80, 0, 0, 0},
+          {"fixcol",   0x400,  25, 0, 0, 0},
+          {"update",   0x400,  40, 0, 0, 0},
+          // elements = input bytes
+          {"import",   0x10000, 4, 0, 0, 0},
+          {"serialize", 0x400, 100, 0, 0, 0},
+        };
+
+        // $ZSDATAB_PAR_THRESHOLD = N or OP=N[,OP=N]...
+        void parse_env() noexcept {
+          const char *env = getenv("ZSDATAB_PAR_THRESHOLD");
+          if(!env) return;
+          for(const char *p = env; *p;) {
+            const char *const end = p + strcspn(p, ",");
+            const char *const eq = static_cast<const char *>(memchr(p, '=', end - p));
+            const size_t n = strtoull(eq ? (eq + 1) : p, nullptr, 10);
+            for(auto &i : _ops)
+              if(!eq || (strlen(i.name) == size_t(eq - p) && !memcmp(i.name, p, eq - p)))
+                i.threshold = n;
+            p = *end ? (end + 1) : end;
+          }
+        }
+
+       public:
+        op_models() noexcept { parse_env(); }
+
+        auto operator[](const par_op op) noexcept -> op_model&
+          { return _ops[static_cast<size_t>(op)]; }
+
+        auto find(const string &name) -> op_model& {
+          for(auto &i : _ops)
+            if(name == i.name)
+              return i;
+          throw out_of_range(string(__PRETTY_FUNCTION__) + ": unknown operation '" + name + "'");
+        }
+
+        auto begin() noexcept -> op_model* { return _ops; }
+        auto end() noexcept -> op_model* { return _ops + par_op_count; }
+      };
+
+      op_models &get_models() noexcept {
+        static op_models ret;
+        return ret;
+      }
+
+      // auto_threshold - smallest n where n * cost * (1 - 1/threads) > overhead
+      size_t auto_threshold(const op_model &m, const size_t conc) noexcept {
+        if(conc < 2) return string::npos;
+        const double gain = m.cost_ns.load(memory_order_relaxed) * (1 - 1.0 / conc);
+        return max(m.min_grain, size_t(par_overhead_ns / max(gain, 0.01)));
+      }
+
+      size_t effective_threshold(const op_model &m, const size_t conc) noexcept {
+        const size_t t = m.threshold.load(memory_order_relaxed);
+        return t ? t : auto_threshold(m, conc);
+      }
+    }
+
+    auto plan_parallel(const par_op op, const size_t n) noexcept -> size_t {
+      if(!n) return 0;
+      if(in_chunk) return 1;
+
+      const size_t conc = current_concurrency();
+      const auto &m = get_models()[op];
+      if(conc < 2 || n < effective_threshold(m, conc)) return 1;
+
+      const size_t grain = max(m.min_grain, size_t(min_chunk_ns / max(m.cost_ns.load(memory_order_relaxed), 0.01)));
+      // a few chunks per thread, so uneven chunks get balanced
+      return max<size_t>(2, min((n + grain - 1) / grain, 4 * conc));
+    }
+
+    void record_sequential(const par_op op, const size_t n, const par_clock::duration dt) noexcept {
+      auto &m = get_models()[op];
+      m.seq_runs.fetch_add(1, memory_order_relaxed);
+      // tiny inputs are dominated by constant costs
+      if(n < 0x100) return;
+      const double per_elem = chrono::duration<double, nano>(dt).count() / n;
+      const double old = m.cost_ns.load(memory_order_relaxed);
+      m.cost_ns.store(old + (per_elem - old) / 8, memory_order_relaxed);
+    }
+
+    void record_parallel(const par_op op) noexcept {
+      auto &m = get_models()[op];
+      m.par_runs.fetch_add(1, memory_order_relaxed);
+      chunk_name = m.name;
+    }
+
+    void run_chunks(const size_t chunks, const function<void (size_t)> &fn) {
+      if(chunks < 2 || in_chunk) {
+        for(size_t c = 0; c < chunks; ++c) fn(c);
+        return;
+      }
+
+      const auto ex = current_executor();
+      if(ex->concurrency() < 2) {
+        for(size_t c = 0; c < chunks; ++c) fn(c);
+        return;
+      }
+
+      error_slot err;
+      const char *const name = chunk_name;
+      ex->run(chunks, [&fn, &err, name](const size_t c) noexcept {
+        chunk_guard guard;
+        trace_scope ts("chunk", name);
+        ts.arg("chunk", c);
+        try {
+          fn(c);
+        } catch(...) {
+          err.set(current_exception());
+        }
+      });
+      err.rethrow();
+    }
+
+    auto in_parallel_chunk() noexcept -> bool {
+      return in_chunk;
+    }
+  }
+}
+
+namespace zsdatab {
+  auto get_parallel_stats() -> vector<parallel_stats> {
+    const size_t conc = intern::current_concurrency();
+    vector<parallel_stats> ret;
+    ret.reserve(intern::par_op_count);
+    for(const auto &i : intern::get_models()) {
+      const size_t t = i.threshold.load(memory_order_relaxed);
+      ret.push_back({
+        i.name, i.cost_ns.load(memory_order_relaxed),
+        intern::effective_threshold(i, conc), t != 0,
+        i.seq_runs.load(memory_order_relaxed), i.par_runs.load(memory_order_relaxed)
+      });
+    }
+    return ret;
+  }
+
+  void set_parallel_threshold(const string &op, const size_t n) {
+    intern::get_models().find(op).threshold = n;
   }
 }
-#endif
@@ -1,18 +1,113 @@
 /**********************************************
- *  object: zsdatab::intern::threadpool
+ *  header: zsdatab::intern::parallel_for
  * library: zsdatable
  * package: zsdatab
  * SPDX-License-Identifier: LGPL-2.1-or-later
  **********************************************/
-
-#include <config.h>
-
-#ifndef HAVE_CXXH_EXECUTION
-#include "3rdparty/ThreadPool/ThreadPool.hpp"
+#pragma once
+#include "zsdatable.hpp"
+#include <stddef.h>
+#include <chrono>
+#include <functional>
+#include <utility>
+#include <vector>
 
 namespace zsdatab {
   namespace intern {
-    extern ThreadPool threadpool;
+    // current_executor - the custom executor or the internal scheduler
+    auto current_executor() -> std::shared_ptr<executor>;
+    // current_concurrency - its concurrency, without a lookup (or starting the scheduler)
+    auto current_concurrency() noexcept -> size_t;
+
+    /* par_op - operations with their own sequential/parallel cost model
+     * (keep in sync with the table in pool.cxx)
+     */
+    enum class par_op : unsigned char { filter, negate, uniq, distinct, sort, group_by, fixcol, update, import, serialize };
+    constexpr size_t par_op_count = 10;
+
+    typedef std::chrono::steady_clock par_clock;
+
+    /* plan_parallel - number of chunks to split n elements of op into
+     * 1 = run sequentially (0 if n == 0)
+     * inputs run in parallel if the estimated sequential time (n * cost per element)
+     * outweighs the scheduling overhead, or if n reaches an overridden threshold;
+     * chunks get enough elements to amortize their dispatch
+     */
+    auto plan_parallel(const par_op op, const size_t n) noexcept -> size_t;
+
+    // record_sequential - feed the time of a sequential run into the cost model of op
+    void record_sequential(const par_op op, const size_t n, const par_clock::duration dt) noexcept;
+    // record_parallel - count a parallel run of op, its name is used for the chunks of the next run_chunks in traces
+    void record_parallel(const par_op op) noexcept;
+
+    /* run_chunks - call fn(c) for every c in [0, chunks), in parallel
+     * the chunks run on current_executor() (the calling thread takes part
+     * in the work, uneven chunks are balanced by work stealing); calls from
+     * inside a chunk run sequentially. The first exception thrown by fn is
+     * rethrown after all chunks are done.
+     */
+    void run_chunks(size_t chunks, const std::function<void (size_t)> &fn);
+
+    // in_parallel_chunk - true while the current thread runs a chunk of run_chunks on the executor
+    auto in_parallel_chunk() noexcept -> bool;
+
+    // parallel_for - call fn(begin, end) for consecutive sub-ranges of [0, n)
+    template<class Fn>
+    void parallel_for(const par_op op, const size_t n, const Fn &fn) {
+      const size_t chunks = plan_parallel(op, n);
+      if(chunks == 1) {
+        const auto start = par_clock::now();
+        fn(size_t(0), n);
+        record_sequential(op, n, par_clock::now() - start);
+      } else if(chunks) {
+        record_parallel(op);
+        run_chunks(chunks, [n, chunks, &fn](const size_t c) {
+          fn(n * c / chunks, n * (c + 1) / chunks);
+        });
+      }
+    }
+
+    /* parallel_filter - erase all elements for which keep returns false, preserving order
+     * every chunk compacts its own part of buf in place (its output buffer),
+     * the parts are joined afterwards; keep must only depend on the element
+     */
+    template<class T, class Fn>
+    void parallel_filter(const par_op op, std::vector<T> &buf, const Fn &keep) {
+      const size_t n = buf.size();
+      const size_t chunks = plan_parallel(op, n);
+      if(!chunks) return;
+
+      std::vector<size_t> ends(chunks);
+      const auto compact = [&buf, &keep, &ends, n, chunks](const size_t c) {
+        const size_t e = n * (c + 1) / chunks;
+        size_t o = n * c / chunks;
+        for(size_t i = o; i < e; ++i) {
+          if(!keep(buf[i])) continue;
+          if(o != i) buf[o] = std::move(buf[i]);
+          ++o;
+        }
+        ends[c] = o;
+      };
+
+      if(chunks == 1) {
+        const auto start = par_clock::now();
+        compact(0);
+        record_sequential(op, n, par_clock::now() - start);
+      } else {
+        record_parallel(op);
+        run_chunks(chunks, compact);
+      }
+
+      size_t o = ends.front();
+      for(size_t c = 1; c < chunks; ++c) {
+        const size_t b = n * c / chunks;
+        if(o != b)
+          for(size_t i = b; i < ends[c]; ++i)
+            buf[o++] = std::move(buf[i]);
+        else
+          o = ends[c];
+      }
+      buf.erase(buf.begin() + o, buf.end());
+    }
   }
 }
-#endif
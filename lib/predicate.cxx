@@ -0,0 +1,528 @@
+/**********************************************
+ *   class: zsdatab::predicate
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "zsdatable.hpp"
+#include "predicate.hpp"
+#include "instrument.hpp"
+#include "number.hpp"
+#include "pool.hpp"
+#include "strsearch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <regex>
+#include <stdexcept>
+
+using namespace std;
+
+namespace zsdatab {
+  struct predicate::node {
+    enum kind_t { AND, OR, NOT, EQUALS, CONTAINS, PREFIX, REGEX, COMPARE };
+
+    kind_t kind;
+    string field, value;
+    cmp_op op = EQ;
+    double num = 0;
+    shared_ptr<const std::regex> re;
+    vector<shared_ptr<const node>> sub;
+  };
+
+  typedef predicate::node pnode;
+
+  static auto make_leaf(const pnode::kind_t kind, const string &field, const string &value) -> predicate {
+    auto n = make_shared<pnode>();
+    n->kind = kind;
+    n->field = field;
+    n->value = value;
+    return predicate(move(n));
+  }
+
+  auto predicate::equals(const string &field, const string &value) -> predicate {
+    return make_leaf(node::EQUALS, field, value);
+  }
+
+  auto predicate::contains(const string &field, const string &value) -> predicate {
+    return make_leaf(node::CONTAINS, field, value);
+  }
+
+  auto predicate::prefix(const string &field, const string &value) -> predicate {
+    return make_leaf(node::PREFIX, field, value);
+  }
+
+  auto predicate::regex(const string &field, const string &pattern) -> predicate {
+    auto n = make_shared<node>();
+    n->kind = node::REGEX;
+    n->field = field;
+    n->value = pattern;
+    n->re = make_shared<std::regex>(pattern, regex_constants::ECMAScript | regex_constants::optimize);
+    return predicate(move(n));
+  }
+
+  auto predicate::compare(const string &field, const cmp_op op, const double value) -> predicate {
+    auto n = make_shared<node>();
+    n->kind = node::COMPARE;
+    n->field = field;
+    n->op = op;
+    n->num = value;
+    return predicate(move(n));
+  }
+
+  static auto make_inner(const pnode::kind_t kind, vector<shared_ptr<const pnode>> sub) -> predicate {
+    auto n = make_shared<pnode>();
+    n->kind = kind;
+    n->sub = move(sub);
+    return predicate(move(n));
+  }
+
+  auto predicate::operator&&(const predicate &o) const -> predicate {
+    return make_inner(node::AND, {_n, o._n});
+  }
+
+  auto predicate::operator||(const predicate &o) const -> predicate {
+    return make_inner(node::OR, {_n, o._n});
+  }
+
+  auto predicate::operator!() const -> predicate {
+    return make_inner(node::NOT, {_n});
+  }
+
+  static void collect_fields(const pnode &n, row_t &ret) {
+    if(n.sub.empty()) {
+      if(find(ret.begin(), ret.end(), n.field) == ret.end())
+        ret.push_back(n.field);
+    } else {
+      for(const auto &i : n.sub)
+        collect_fields(*i, ret);
+    }
+  }
+
+  auto predicate::fields() const -> row_t {
+    row_t ret;
+    collect_fields(*_n, ret);
+    return ret;
+  }
+
+  static string quote(const string &s) {
+    string ret = "\"";
+    for(const char c : s) {
+      if(c == '"' || c == '\\') ret += '\\';
+      ret += c;
+    }
+    return ret + '"';
+  }
+
+  static const char *cmp_op_name(const predicate::cmp_op op) noexcept {
+    switch(op) {
+      case predicate::LT: return "<";
+      case predicate::LE: return "<=";
+      case predicate::GT: return ">";
+      case predicate::GE: return ">=";
+      case predicate::EQ: return "==";
+      case predicate::NE: return "<>";
+    }
+    return "";
+  }
+
+  static string node_to_string(const pnode &n) {
+    switch(n.kind) {
+      case pnode::AND:
+      case pnode::OR:
+        {
+          string ret = "(";
+          for(size_t i = 0; i < n.sub.size(); ++i) {
+            if(i) ret += (n.kind == pnode::AND) ? " and " : " or ";
+            ret += node_to_string(*n.sub[i]);
+          }
+          return ret + ')';
+        }
+
+      case pnode::NOT:      return "not " + node_to_string(*n.sub.front());
+      case pnode::EQUALS:   return quote(n.field) + " = "  + quote(n.value);
+      case pnode::CONTAINS: return quote(n.field) + " ~ "  + quote(n.value);
+      case pnode::PREFIX:   return quote(n.field) + " ^= " + quote(n.value);
+      case pnode::REGEX:    return quote(n.field) + " =~ " + quote(n.value);
+
+      case pnode::COMPARE:
+        {
+          char tmp[32];
+          snprintf(tmp, sizeof(tmp), "%.17g", n.num);
+          return quote(n.field) + ' ' + cmp_op_name(n.op) + ' ' + tmp;
+        }
+    }
+    return {};
+  }
+
+  auto predicate::to_string() const -> string {
+    return node_to_string(*_n);
+  }
+
+  // parser
+  namespace {
+    class predicate_parser {
+      const string &_s;
+      size_t _pos = 0;
+
+      struct token {
+        enum kind_t { END, WORD, STRING, OP, LPAREN, RPAREN } kind;
+        string text;
+        size_t pos;
+      };
+
+      token _cur;
+
+      [[noreturn]] void fail(const string &msg) const {
+        throw invalid_argument("zsdatab::predicate::parse: " + msg + " at position " + std::to_string(_cur.pos));
+      }
+
+      static bool is_word_char(const char c) noexcept {
+        return !isspace(static_cast<unsigned char>(c)) && !strchr("()=!<>~^&|\"'", c);
+      }
+
+      void next() {
+        while(_pos < _s.size() && isspace(static_cast<unsigned char>(_s[_pos]))) ++_pos;
+        _cur = {token::END, {}, _pos};
+        if(_pos == _s.size()) return;
+
+        const char c = _s[_pos];
+        if(c == '(' || c == ')') {
+          _cur.kind = (c == '(') ? token::LPAREN : token::RPAREN;
+          ++_pos;
+        } else if(c == '"' || c == '\'') {
+          _cur.kind = token::STRING;
+          for(++_pos; _pos < _s.size() && _s[_pos] != c; ++_pos) {
+            if(_s[_pos] == '\\' && _pos + 1 < _s.size()) ++_pos;
+            _cur.text += _s[_pos];
+          }
+          if(_pos == _s.size()) fail("unterminated string");
+          ++_pos;
+        } else if(is_word_char(c)) {
+          _cur.kind = token::WORD;
+          while(_pos < _s.size() && is_word_char(_s[_pos]))
+            _cur.text += _s[_pos++];
+        } else {
+          static const char *const ops[] = { "!=", "^=", "=~", "<=", ">=", "<>", "==", "&&", "||", "=", "~", "<", ">", "!" };
+          for(const auto i : ops) {
+            const size_t l = strlen(i);
+            if(!_s.compare(_pos, l, i)) {
+              _cur.kind = token::OP;
+              _cur.text = i;
+              _pos += l;
+              return;
+            }
+          }
+          fail(string("unexpected character '") + c + '\'');
+        }
+      }
+
+      bool is_keyword(const char *kw) const noexcept {
+        if(_cur.kind != token::WORD || _cur.text.size() != strlen(kw)) return false;
+        for(size_t i = 0; kw[i]; ++i)
+          if(tolower(static_cast<unsigned char>(_cur.text[i])) != kw[i])
+            return false;
+        return true;
+      }
+
+      bool at_op(const char *op) const noexcept
+        { return _cur.kind == token::OP && _cur.text == op; }
+
+      string operand(const char *what) {
+        if(_cur.kind != token::WORD && _cur.kind != token::STRING)
+          fail(string("expected ") + what);
+        string ret = move(_cur.text);
+        next();
+        return ret;
+      }
+
+      predicate parse_or() {
+        predicate ret = parse_and();
+        while(is_keyword("or") || at_op("||")) {
+          next();
+          ret = ret || parse_and();
+        }
+        return ret;
+      }
+
+      predicate parse_and() {
+        predicate ret = parse_unary();
+        while(is_keyword("and") || at_op("&&")) {
+          next();
+          ret = ret && parse_unary();
+        }
+        return ret;
+      }
+
+      predicate parse_unary() {
+        if(is_keyword("not") || at_op("!")) {
+          next();
+          return !parse_unary();
+        } else if(_cur.kind == token::LPAREN) {
+          next();
+          predicate ret = parse_or();
+          if(_cur.kind != token::RPAREN) fail("expected ')'");
+          next();
+          return ret;
+        }
+
+        const string field = operand("field name");
+        if(_cur.kind != token::OP) fail("expected comparison operator");
+        const string op = move(_cur.text);
+        next();
+        const string value = operand("value");
+
+        if(op == "=")  return predicate::equals(field, value);
+        if(op == "!=") return !predicate::equals(field, value);
+        if(op == "~")  return predicate::contains(field, value);
+        if(op == "^=") return predicate::prefix(field, value);
+        if(op == "=~") {
+          try {
+            return predicate::regex(field, value);
+          } catch(const regex_error &e) {
+            fail("invalid regex (" + string(e.what()) + ')');
+          }
+        }
+
+        predicate::cmp_op cop;
+        if(op == "<")       cop = predicate::LT;
+        else if(op == "<=") cop = predicate::LE;
+        else if(op == ">")  cop = predicate::GT;
+        else if(op == ">=") cop = predicate::GE;
+        else if(op == "==") cop = predicate::EQ;
+        else if(op == "<>") cop = predicate::NE;
+        else fail("unknown comparison operator '" + op + '\'');
+
+        double num;
+        if(!intern::parse_decimal(value, num)) fail("expected number");
+        return predicate::compare(field, cop, num);
+      }
+
+     public:
+      explicit predicate_parser(const string &s)
+        : _s(s) { next(); }
+
+      predicate run() {
+        predicate ret = parse_or();
+        if(_cur.kind != token::END) fail("unexpected '" + _cur.text + '\'');
+        return ret;
+      }
+    };
+  }
+
+  auto predicate::parse(const string &expr) -> predicate {
+    return predicate_parser(expr).run();
+  }
+
+  // compiler
+  namespace {
+    enum opcode : uint8_t {
+      OP_EQUALS, OP_CONTAINS, OP_PREFIX, OP_REGEX, OP_COMPARE,
+      OP_JF, // jump if false
+      OP_JT  // jump if true
+    };
+
+    struct instr {
+      opcode op;
+      bool neg;
+      predicate::cmp_op cmp;
+      size_t arg; // field or jump target
+      double num;
+      string value;
+      const std::regex *re;
+      shared_ptr<const intern::substring_searcher> srch;
+    };
+
+    /* program - flat evaluation program for a predicate
+     * NOT is pushed down to the leaves (neg flags), and/or are evaluated
+     * with short-circuit jumps; the accumulator holds the last test result
+     */
+    class program {
+      vector<instr> _code;
+      // keeps the regex objects alive
+      shared_ptr<const pnode> _root;
+
+      // estimated evaluation cost, used to put cheap operands of and/or first
+      static double cost(const pnode &n) noexcept {
+        switch(n.kind) {
+          case pnode::EQUALS:
+          case pnode::PREFIX:   return 1;
+          case pnode::CONTAINS: return 2 + n.value.size() / 16.0;
+          case pnode::COMPARE:  return 4;
+          case pnode::REGEX:    return 32;
+          default:
+            {
+              double ret = 0;
+              for(const auto &i : n.sub)
+                ret += cost(*i);
+              return ret;
+            }
+        }
+      }
+
+      static void flatten(const pnode &n, const pnode::kind_t kind, vector<const pnode *> &ret) {
+        for(const auto &i : n.sub) {
+          if(i->kind == kind) flatten(*i, kind, ret);
+          else ret.push_back(i.get());
+        }
+      }
+
+      void emit(const metadata &meta, const pnode &n, const bool neg) {
+        switch(n.kind) {
+          case pnode::NOT:
+            emit(meta, *n.sub.front(), !neg);
+            return;
+
+          case pnode::AND:
+          case pnode::OR:
+            {
+              vector<const pnode *> ops;
+              flatten(n, n.kind, ops);
+              stable_sort(ops.begin(), ops.end(), [](const pnode *a, const pnode *b) noexcept {
+                return cost(*a) < cost(*b);
+              });
+
+              // not (a and b) = (not a) or (not b)
+              const opcode jmp = ((n.kind == pnode::AND) != neg) ? OP_JF : OP_JT;
+              vector<size_t> patch;
+              for(size_t i = 0; i < ops.size(); ++i) {
+                emit(meta, *ops[i], neg);
+                if(i + 1 == ops.size()) break;
+                patch.push_back(_code.size());
+                _code.push_back({jmp, false, predicate::EQ, 0, 0, {}, nullptr, nullptr});
+              }
+              for(const auto i : patch)
+                _code[i].arg = _code.size();
+            }
+            return;
+
+          default:
+            break;
+        }
+
+        instr i{OP_EQUALS, neg, n.op, meta.get_field_nr(n.field), n.num, n.value, n.re.get(), nullptr};
+        switch(n.kind) {
+          case pnode::CONTAINS:
+            i.op = OP_CONTAINS;
+            i.srch = make_shared<intern::substring_searcher>(n.value);
+            break;
+          case pnode::PREFIX:   i.op = OP_PREFIX;   break;
+          case pnode::REGEX:    i.op = OP_REGEX;    break;
+          case pnode::COMPARE:  i.op = OP_COMPARE;  break;
+          default:                                  break;
+        }
+        _code.push_back(move(i));
+      }
+
+      [[gnu::hot]]
+      static bool test(const instr &i, const string &f) noexcept {
+        switch(i.op) {
+          case OP_EQUALS:   return f == i.value;
+          case OP_CONTAINS: return i.srch->in(f);
+          case OP_PREFIX:   return !f.compare(0, i.value.size(), i.value);
+          case OP_REGEX:    return regex_search(f, *i.re);
+
+          case OP_COMPARE:
+            {
+              double x;
+              if(!intern::parse_decimal(f, x)) return false;
+              switch(i.cmp) {
+                case predicate::LT: return x <  i.num;
+                case predicate::LE: return x <= i.num;
+                case predicate::GT: return x >  i.num;
+                case predicate::GE: return x >= i.num;
+                case predicate::EQ: return x == i.num;
+                case predicate::NE: return x != i.num;
+              }
+            }
+            return false;
+
+          default:
+            return false;
+        }
+      }
+
+     public:
+      // this function may throw an out_of_range exception if a field isn't found
+      program(const metadata &meta, const predicate &pred)
+        : _root(pred.get_node()) { emit(meta, *_root, false); }
+
+      [[gnu::hot]]
+      bool operator()(const row_t &row) const noexcept {
+        bool acc = true;
+        const size_t n = _code.size();
+        for(size_t pc = 0; pc < n;) {
+          const auto &i = _code[pc];
+          switch(i.op) {
+            case OP_JF: pc = acc ? (pc + 1) : i.arg; continue;
+            case OP_JT: pc = acc ? i.arg : (pc + 1); continue;
+            default:    acc = (i.neg != test(i, row[i.arg]));
+          }
+          ++pc;
+        }
+        return acc;
+      }
+    };
+  }
+
+  namespace intern {
+    struct row_matcher::impl {
+      program prog;
+    };
+
+    row_matcher::row_matcher(const metadata &meta, const predicate &pred)
+      : _impl(new impl{program(meta, pred)}) { }
+
+    row_matcher::~row_matcher() noexcept = default;
+
+    bool row_matcher::operator()(const row_t &row) const noexcept {
+      return _impl->prog(row);
+    }
+
+    context_common& context_common::filter(const predicate &pred, const size_t limit) {
+      if(empty()) return *this;
+
+      const program prog(get_metadata(), pred);
+      op_timer t(event_type::filter, rows().size());
+      const auto &b = *_base;
+      if(limit == string::npos) {
+        parallel_filter(par_op::filter, sel(), [&b, &prog](const size_t i) noexcept { return prog(*b[i]); });
+      } else {
+        // sequential streaming scan, stops after 'limit' matches
+        const auto v = rows();
+        vector<size_t> pos;
+        for(size_t i = 0; i < v.size() && pos.size() < limit; ++i)
+          if(prog(v[i])) pos.push_back(i);
+        select_positions(pos);
+      }
+
+      t.rows_out(rows().size());
+      return *this;
+    }
+
+    auto context_common::count(const predicate &pred) const -> size_t {
+      const program prog(get_metadata(), pred);
+      const auto v = rows();
+      atomic<size_t> ret(0);
+      parallel_for(par_op::filter, v.size(), [&v, &prog, &ret](const size_t b, const size_t e) noexcept {
+        size_t n = 0;
+        for(size_t i = b; i < e; ++i)
+          if(prog(v[i])) ++n;
+        ret += n;
+      });
+      return ret;
+    }
+
+    bool context_common::exists(const predicate &pred) const {
+      // sequential streaming scan, stops at the first match
+      const program prog(get_metadata(), pred);
+      for(const auto &i : rows())
+        if(prog(i)) return true;
+      return false;
+    }
+  }
+}
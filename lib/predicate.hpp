@@ -0,0 +1,26 @@
+/**********************************************
+ *  header: zsdatab::intern::row_matcher
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+#pragma once
+#include "zsdatable.hpp"
+
+namespace zsdatab {
+  namespace intern {
+    // row_matcher - predicate compiled against metadata (can be used by many threads at once)
+    class row_matcher final {
+     public:
+      // this function may throw an out_of_range exception if a field isn't found
+      row_matcher(const metadata &meta, const predicate &pred);
+      ~row_matcher() noexcept;
+
+      bool operator()(const row_t &row) const noexcept;
+
+     private:
+      struct impl;
+      std::unique_ptr<const impl> _impl;
+    };
+  }
+}
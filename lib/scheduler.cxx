@@ -0,0 +1,314 @@
+/**********************************************
+ *  object: zsdatab::intern::scheduler
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "zsdatable.hpp"
+#include "perf.hpp"
+#include "pool.hpp"
+#include "trace.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#ifdef __linux__
+# include <sched.h>
+#endif
+
+using namespace std;
+
+namespace zsdatab {
+  namespace intern {
+    namespace {
+      // default thread count = CPUs the process may run on
+      size_t default_thread_count() noexcept {
+        if(const char *env = getenv("ZSDATAB_THREADS")) {
+          const long n = strtol(env, nullptr, 10);
+          if(n > 0) return n;
+        }
+#ifdef __linux__
+        cpu_set_t cs;
+        if(!sched_getaffinity(0, sizeof(cs), &cs)) {
+          const int n = CPU_COUNT(&cs);
+          if(n > 0) return n;
+        }
+#endif
+        return max(1u, thread::hardware_concurrency());
+      }
+
+      struct job {
+        const function<void (size_t)> &fn;
+        // the job may be destroyed as soon as left reaches 0
+        atomic<size_t> left;
+
+        job(const function<void (size_t)> &f, const size_t n)
+          : fn(f), left(n) { }
+      };
+
+      // task = range of indices of a job, split in halves until it is a single index
+      struct task {
+        job *j;
+        size_t from, to;
+      };
+
+      struct task_queue {
+        mutex mtx;
+        deque<task> tasks;
+      };
+
+      /* scheduler - work-stealing thread pool
+       * every worker owns a deque, it pushes and pops at the back, thieves
+       * steal the oldest (largest) ranges from the front; threads outside
+       * the pool push into the shared queue (_queues[0]) and help until
+       * their job is done. Idle workers and waiting callers sleep on
+       * _sleep_cv, which is notified by push and by finished jobs
+       */
+      class scheduler final : public executor {
+        const size_t _threads;
+        vector<unique_ptr<task_queue>> _queues;
+        vector<thread> _workers;
+        // _sleeping = idle workers and waiting callers
+        atomic<size_t> _pending, _sleeping;
+        // threads running a task (only counted while tracing)
+        atomic<int64_t> _busy;
+        mutex _sleep_mtx;
+        condition_variable _sleep_cv;
+        bool _stop;
+
+        // queue of the current thread, if it is one of our workers
+        static thread_local const scheduler *_owner;
+        static thread_local task_queue *_own;
+
+        auto own_queue() const noexcept -> task_queue*
+          { return (_owner == this) ? _own : nullptr; }
+
+        void push(const task &t) {
+          {
+            const auto own = own_queue();
+            auto &q = own ? *own : *_queues.front();
+            lock_guard<mutex> lock(q.mtx);
+            q.tasks.push_back(t);
+          }
+          _pending.fetch_add(1);
+          if(_sleeping.load()) {
+            { lock_guard<mutex> lock(_sleep_mtx); }
+            _sleep_cv.notify_one();
+          }
+        }
+
+        auto pop(const size_t self) -> optional<task> {
+          const auto own = own_queue();
+          if(own) {
+            lock_guard<mutex> lock(own->mtx);
+            if(!own->tasks.empty()) {
+              const task ret = own->tasks.back();
+              own->tasks.pop_back();
+              _pending.fetch_sub(1);
+              return ret;
+            }
+          }
+
+          // steal, starting with the next queue
+          const size_t qn = _queues.size();
+          for(size_t i = 1; i <= qn; ++i) {
+            auto &q = *_queues[(self + i) % qn];
+            if(&q == own) continue;
+            lock_guard<mutex> lock(q.mtx);
+            if(!q.tasks.empty()) {
+              const task ret = q.tasks.front();
+              q.tasks.pop_front();
+              _pending.fetch_sub(1);
+              return ret;
+            }
+          }
+          return {};
+        }
+
+        void execute(task t) {
+          hw_attach();
+          while(t.to - t.from > 1) {
+            const size_t mid = t.from + (t.to - t.from) / 2;
+            push({t.j, mid, t.to});
+            t.to = mid;
+          }
+
+          if(tracing()) {
+            trace_counter("busy threads", _busy.fetch_add(1) + 1);
+            {
+              trace_scope ts("task", "task");
+              ts.arg("index", t.from);
+              t.j->fn(t.from);
+            }
+            trace_counter("busy threads", _busy.fetch_sub(1) - 1);
+          } else {
+            t.j->fn(t.from);
+          }
+          if(t.j->left.fetch_sub(1) == 1 && _sleeping.load()) {
+            // wake the caller (t.j must not be used anymore)
+            { lock_guard<mutex> lock(_sleep_mtx); }
+            _sleep_cv.notify_all();
+          }
+        }
+
+        void work(const size_t self) {
+          _owner = this;
+          _own = _queues[self].get();
+          trace_thread_name("zsdatab worker " + to_string(self));
+          for(;;) {
+            if(const auto t = pop(self)) {
+              execute(*t);
+              continue;
+            }
+
+            unique_lock<mutex> lock(_sleep_mtx);
+            _sleeping.fetch_add(1);
+            _sleep_cv.wait(lock, [this] { return _stop || _pending.load(); });
+            _sleeping.fetch_sub(1);
+            if(_stop) return;
+          }
+        }
+
+       public:
+        explicit scheduler(const size_t threads)
+          : _threads(max<size_t>(threads, 1)), _pending(0), _sleeping(0), _busy(0), _stop(false)
+        {
+          _queues.reserve(_threads);
+          for(size_t i = 0; i < _threads; ++i)
+            _queues.emplace_back(make_unique<task_queue>());
+          // the calling thread is one of the threads
+          _workers.reserve(_threads - 1);
+          for(size_t i = 1; i < _threads; ++i)
+            _workers.emplace_back(&scheduler::work, this, i);
+        }
+
+        ~scheduler() noexcept {
+          {
+            lock_guard<mutex> lock(_sleep_mtx);
+            _stop = true;
+          }
+          _sleep_cv.notify_all();
+          for(auto &i : _workers) i.join();
+        }
+
+        auto concurrency() const noexcept -> size_t override
+          { return _threads; }
+
+        void run(const size_t n, const function<void (size_t)> &fn) override {
+          if(!n) return;
+          if(_threads == 1 || n == 1) {
+            for(size_t i = 0; i < n; ++i) fn(i);
+            return;
+          }
+
+          job j(fn, n);
+          execute({&j, 0, n});
+
+          // help until the job is done, sleep while there is nothing to steal
+          while(j.left.load()) {
+            if(const auto t = pop(0)) {
+              execute(*t);
+              continue;
+            }
+            unique_lock<mutex> lock(_sleep_mtx);
+            _sleeping.fetch_add(1);
+            _sleep_cv.wait(lock, [this, &j] { return !j.left.load() || _pending.load(); });
+            _sleeping.fetch_sub(1);
+          }
+        }
+      };
+
+      thread_local const scheduler *scheduler::_owner = nullptr;
+      thread_local task_queue *scheduler::_own = nullptr;
+
+      /* exec_state - the lookups of every parallel operation don't lock mtx:
+       * current (custom or internal, accessed with atomic_load/atomic_store) and
+       * conc (its concurrency) are set on first use, reset by set_executor and
+       * set_thread_count
+       */
+      struct exec_state {
+        mutex mtx;
+        shared_ptr<executor> custom;
+        shared_ptr<scheduler> internal;
+        size_t threads = 0;
+        shared_ptr<executor> current;
+        atomic<size_t> conc{0};
+
+        // reset - mtx must be locked
+        void reset() noexcept {
+          atomic_store(&current, shared_ptr<executor>());
+          conc.store(0);
+        }
+      };
+
+      exec_state &get_state() {
+        static exec_state ret;
+        return ret;
+      }
+    }
+
+    auto current_executor() -> shared_ptr<executor> {
+      auto &st = get_state();
+      if(auto ret = atomic_load(&st.current)) return ret;
+
+      lock_guard<mutex> lock(st.mtx);
+      if(!st.current) {
+        if(!st.custom && !st.internal)
+          st.internal = make_shared<scheduler>(st.threads ? st.threads : default_thread_count());
+        atomic_store(&st.current, st.custom ? st.custom : shared_ptr<executor>(st.internal));
+      }
+      return st.current;
+    }
+
+    auto current_concurrency() noexcept -> size_t {
+      auto &st = get_state();
+      if(const size_t ret = st.conc.load()) return ret;
+
+      // the internal scheduler isn't started for this
+      lock_guard<mutex> lock(st.mtx);
+      size_t ret;
+      if(st.custom)        ret = st.custom->concurrency();
+      else if(st.internal) ret = st.internal->concurrency();
+      else                 ret = st.threads ? st.threads : default_thread_count();
+      ret = max<size_t>(ret, 1);
+      st.conc.store(ret);
+      return ret;
+    }
+  }
+
+  void set_executor(shared_ptr<executor> ex) {
+    auto &st = intern::get_state();
+    lock_guard<mutex> lock(st.mtx);
+    st.custom = move(ex);
+    st.reset();
+  }
+
+  auto get_executor() -> shared_ptr<executor> {
+    return intern::current_executor();
+  }
+
+  void set_thread_count(const size_t n) {
+    auto &st = intern::get_state();
+    shared_ptr<intern::scheduler> old;
+    {
+      lock_guard<mutex> lock(st.mtx);
+      st.threads = n;
+      old = move(st.internal);
+      st.reset();
+    }
+    // the old workers are joined here (or by the last running operation)
+  }
+
+  auto get_thread_count() -> size_t {
+    auto &st = intern::get_state();
+    lock_guard<mutex> lock(st.mtx);
+    if(st.internal) return st.internal->concurrency();
+    return st.threads ? st.threads : intern::default_thread_count();
+  }
+}
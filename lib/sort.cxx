@@ -0,0 +1,269 @@
+/**********************************************
+ *    part: normalized-key sort engine
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "sort.hpp"
+#include "pool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+
+using namespace std;
+
+namespace zsdatab {
+  namespace intern {
+    namespace {
+      struct sort_entry {
+        uint64_t key;
+        size_t idx;
+      };
+
+      // buckets smaller than this are sorted via comparison sort
+      constexpr size_t radix_cutoff = 64;
+
+      /* normalized key prefix of a field (starting at byte off)
+       * bytes 7..1 (MSB first) : the next 7 bytes of the field, zero padded
+       * byte  0                : min(remaining length, 8)
+       *
+       * key(a) < key(b) implies a < b; equal keys with a length byte < 8
+       * mean that the fields are equal, otherwise the next 7 bytes decide
+       */
+      [[gnu::hot]]
+      inline uint64_t normalized_key(const string &s, const size_t off) noexcept {
+        const size_t rem = s.size() - off;
+        const size_t l = min<size_t>(rem, 7);
+        const char *p = s.data() + off;
+        uint64_t ret = 0;
+        for(size_t i = 0; i < l; ++i)
+          ret |= uint64_t(uint8_t(p[i])) << (56 - 8 * i);
+        return ret | min<size_t>(rem, 8);
+      }
+
+      [[gnu::hot]]
+      inline int row_compare(const row_t &a, const row_t &b, const sort_columns &cols) noexcept {
+        for(const auto &i : cols) {
+          const int c = a[i.field].compare(b[i.field]);
+          if(c) return (i.order == desc) ? -c : c;
+        }
+        return 0;
+      }
+
+      inline uint64_t order_mask(const sort_column &c) noexcept {
+        return (c.order == desc) ? ~uint64_t(0) : 0;
+      }
+
+      inline bool entry_less(const sort_entry &a, const sort_entry &b) noexcept {
+        return a.key < b.key || (a.key == b.key && a.idx < b.idx);
+      }
+
+      // stable MSD radix sort of entries by key, 8 bits per pass
+      void msd_radix(sort_entry *a, sort_entry *tmp, const size_t n, const unsigned shift, const bool par) {
+        if(n <= radix_cutoff) {
+          std::sort(a, a + n, entry_less);
+          return;
+        }
+
+        size_t offs[257] = { 0 };
+        for(size_t i = 0; i < n; ++i)
+          ++offs[((a[i].key >> shift) & 0xff) + 1];
+
+        // everything falls into one bucket, go on with the next byte
+        if(find(begin(offs) + 1, end(offs), n) != end(offs)) {
+          if(shift) msd_radix(a, tmp, n, shift - 8, par);
+          return;
+        }
+
+        partial_sum(begin(offs), end(offs), begin(offs));
+        {
+          size_t pos[256];
+          copy_n(begin(offs), 256, pos);
+          for(size_t i = 0; i < n; ++i)
+            tmp[pos[(a[i].key >> shift) & 0xff]++] = a[i];
+        }
+        memcpy(a, tmp, n * sizeof(sort_entry));
+
+        if(!shift) return;
+
+        const auto sub = [a, tmp, &offs, shift](const size_t b) {
+          msd_radix(a + offs[b], tmp + offs[b], offs[b + 1] - offs[b], shift - 8, false);
+        };
+
+        if(par) {
+          run_chunks(256, sub);
+        } else {
+          for(size_t b = 0; b < 256; ++b) sub(b);
+        }
+      }
+
+      // a run of entries which are equal up to (column col, byte off)
+      struct sort_run {
+        size_t begin, end;
+        size_t col, off;
+        // number of key passes which led to this run
+        size_t depth;
+      };
+
+      // runs which are still equal after this many key passes are sorted via comparison sort
+      constexpr size_t max_key_passes = 8;
+
+      /* compare_from - row_compare for rows which are equal up to (column col, byte off)
+       * (both fields of column col are at least off bytes long)
+       */
+      [[gnu::hot]]
+      inline int compare_from(const row_t &a, const row_t &b, const sort_columns &cols, const size_t col, const size_t off) noexcept {
+        const auto &fa = a[cols[col].field], &fb = b[cols[col].field];
+        const int c = fa.compare(off, string::npos, fb, off, string::npos);
+        if(c) return (cols[col].order == desc) ? -c : c;
+        for(size_t i = col + 1; i < cols.size(); ++i) {
+          const int d = a[cols[i].field].compare(b[cols[i].field]);
+          if(d) return (cols[i].order == desc) ? -d : d;
+        }
+        return 0;
+      }
+
+      // comparison sort of a run, equal rows in index order
+      void compare_sort(const row_view &buf, const sort_columns &cols, sort_entry *a, const sort_run &r) {
+        std::sort(a + r.begin, a + r.end, [&buf, &cols, &r](const sort_entry &x, const sort_entry &y) noexcept {
+          const int c = compare_from(buf[x.idx], buf[y.idx], cols, r.col, r.off);
+          return c ? (c < 0) : (x.idx < y.idx);
+        });
+      }
+
+      /* key_pass - sort a run by the key at (r.col, r.off)
+       * computes the keys, radix sorts by them and appends the runs of equal keys
+       * (with the following key position) to todo
+       */
+      void key_pass(const row_view &buf, const sort_columns &cols, sort_entry *a, sort_entry *tmp,
+                    const sort_run &r, const bool par, vector<sort_run> &todo)
+      {
+        const size_t n = r.end - r.begin;
+        a += r.begin;
+        tmp += r.begin;
+
+        const size_t kf = cols[r.col].field;
+        const uint64_t kx = order_mask(cols[r.col]);
+        const auto mkkey = [&buf, kf, kx, &r](sort_entry &e) noexcept {
+          e.key = normalized_key(buf[e.idx][kf], r.off) ^ kx;
+        };
+
+        if(par) {
+          const size_t chunks = plan_parallel(par_op::sort, n);
+          run_chunks(chunks, [a, n, chunks, &mkkey](const size_t c) noexcept {
+            for_each(a + n * c / chunks, a + n * (c + 1) / chunks, mkkey);
+          });
+        } else {
+          for_each(a, a + n, mkkey);
+        }
+
+        msd_radix(a, tmp, n, 56, par);
+
+        for(size_t i = 0; i < n;) {
+          size_t j = i + 1;
+          while(j < n && a[j].key == a[i].key) ++j;
+          if(j - i > 1) {
+            // a length byte < 8 means: this field is equal in the whole run
+            if(((a[i].key ^ kx) & 0xff) == 8)
+              todo.push_back({r.begin + i, r.begin + j, r.col, r.off + 7, r.depth + 1});
+            else if(r.col + 1 < cols.size())
+              todo.push_back({r.begin + i, r.begin + j, r.col + 1, 0, r.depth + 1});
+          }
+          i = j;
+        }
+      }
+
+      // finish_run - sort a run completely, small or deep runs via comparison sort
+      void finish_run(const row_view &buf, const sort_columns &cols, sort_entry *a, sort_entry *tmp, const sort_run &run) {
+        vector<sort_run> todo = { run };
+        while(!todo.empty()) {
+          const sort_run r = todo.back();
+          todo.pop_back();
+          if(r.end - r.begin <= radix_cutoff || r.depth >= max_key_passes)
+            compare_sort(buf, cols, a, r);
+          else
+            key_pass(buf, cols, a, tmp, r, false, todo);
+        }
+      }
+
+      // sort_range - sort n entries, the first key pass runs in parallel if par is set
+      void sort_range(const row_view &buf, const sort_columns &cols, sort_entry *a, sort_entry *tmp,
+                      const size_t n, const bool par)
+      {
+        vector<sort_run> runs;
+        key_pass(buf, cols, a, tmp, {0, n, 0, 0, 0}, par, runs);
+
+        const auto sub = [&](const sort_run &r) { finish_run(buf, cols, a, tmp, r); };
+        if(par) run_chunks(runs.size(), [&runs, &sub](const size_t r) { sub(runs[r]); });
+        else    for_each(runs.begin(), runs.end(), sub);
+      }
+    }
+
+    auto sort_rows(const row_view &buf, const sort_columns &cols, const bool stable) -> vector<size_t> {
+      const size_t n = buf.size();
+      if(n < 2 * radix_cutoff) {
+        const auto cmp = [&buf, &cols](const size_t a, const size_t b) noexcept {
+          return row_compare(buf[a], buf[b], cols) < 0;
+        };
+
+        vector<size_t> ret(n);
+        iota(ret.begin(), ret.end(), 0);
+        if(stable) std::stable_sort(ret.begin(), ret.end(), cmp);
+        else       std::sort(ret.begin(), ret.end(), cmp);
+        return ret;
+      }
+
+      // equal rows always end up in index order, so the result is stable either way
+      vector<sort_entry> ents(n), tmp(n);
+      for(size_t i = 0; i < n; ++i)
+        ents[i].idx = i;
+
+      const bool par = plan_parallel(par_op::sort, n) > 1;
+      if(par) record_parallel(par_op::sort);
+      const auto start = par_clock::now();
+      sort_range(buf, cols, ents.data(), tmp.data(), n, par);
+      if(!par) record_sequential(par_op::sort, n, par_clock::now() - start);
+      tmp = {};
+
+      vector<size_t> ret(n);
+      transform(ents.begin(), ents.end(), ret.begin(), [](const sort_entry &e) noexcept { return e.idx; });
+      return ret;
+    }
+
+    auto top_k_rows(const row_view &buf, const sort_columns &cols, const size_t k) -> vector<size_t> {
+      const size_t n = buf.size();
+      if(!k) {
+        return {};
+      } else if(k >= n / 2) {
+        // partial selection doesn't pay off
+        auto ret = sort_rows(buf, cols, true);
+        if(n > k) ret.resize(k);
+        return ret;
+      }
+
+      // max-heap of the k smallest rows seen so far (on ties, earlier rows are smaller)
+      const auto less = [&buf, &cols](const size_t a, const size_t b) noexcept {
+        const int c = row_compare(buf[a], buf[b], cols);
+        return c ? (c < 0) : (a < b);
+      };
+
+      vector<size_t> heap;
+      heap.reserve(k);
+      for(size_t i = 0; i < n; ++i) {
+        if(heap.size() < k) {
+          heap.push_back(i);
+          push_heap(heap.begin(), heap.end(), less);
+        } else if(less(i, heap.front())) {
+          pop_heap(heap.begin(), heap.end(), less);
+          heap.back() = i;
+          push_heap(heap.begin(), heap.end(), less);
+        }
+      }
+      sort_heap(heap.begin(), heap.end(), less);
+      return heap;
+    }
+  }
+}
@@ -0,0 +1,37 @@
+/**********************************************
+ *  header: zsdatab::intern::sort_rows
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+#pragma once
+#include "zsdatable.hpp"
+namespace zsdatab {
+  namespace intern {
+    /* sort_rows - sort rows by the given columns
+     * @return : vector<size_t> : the row positions (in rows) in sort order
+     *
+     * rows are sorted via normalized 8-byte key prefixes (MSD radix sort),
+     * rows with equal prefixes are refined with the following key bytes;
+     * small inputs, small runs and runs still equal after a few refinements
+     * are sorted via comparison sort
+     *
+     * @param rows   : row_view : the rows to sort
+     * @param cols   : sort_columns : the sort keys (must be non-empty)
+     * @param stable : bool : keep the relative order of equal rows
+     */
+    auto sort_rows(const row_view &rows, const sort_columns &cols, const bool stable) -> std::vector<size_t>;
+
+    /* top_k_rows - select the first k rows (in sort order)
+     * @return : vector<size_t> : the row positions (in rows) of the selected rows, in sort order
+     *
+     * small k use a bounded heap (O(n log k)), large k a full sort;
+     * rows with equal keys keep their relative order
+     *
+     * @param rows : row_view : the rows to select from
+     * @param cols : sort_columns : the sort keys
+     * @param k    : size_t : number of rows to keep
+     */
+    auto top_k_rows(const row_view &rows, const sort_columns &cols, const size_t k) -> std::vector<size_t>;
+  }
+}
@@ -0,0 +1,53 @@
+/**********************************************
+ *  header: zsdatab::intern::stopwatch
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+#pragma once
+#include "zsdatable.hpp"
+#include "perf.hpp"
+#include "trace.hpp"
+#include <time.h>
+
+namespace zsdatab {
+  namespace intern {
+    // process_cpu_time - CPU time of all threads of the process
+    static inline auto process_cpu_time() noexcept -> std::chrono::nanoseconds {
+      timespec ts;
+      if(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts)) return {};
+      return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+    }
+
+    // stopwatch - wall and CPU time (and hardware counters, if enabled) of a stage
+    class stopwatch final {
+      std::chrono::steady_clock::time_point _wall;
+      std::chrono::nanoseconds _cpu;
+      hw_counters _hw;
+
+     public:
+      stopwatch() noexcept
+        { restart(); }
+
+      void restart() noexcept {
+        _hw = read_hw_counters();
+        _wall = std::chrono::steady_clock::now();
+        _cpu = process_cpu_time();
+      }
+
+      // lap - store the time since the (re)start in st and restart, trace it as name (if not null)
+      void lap(io_stats::stage &st, const char *name = nullptr, const trace_arg arg = {}) noexcept {
+        const auto wall = std::chrono::steady_clock::now();
+        if(name && tracing()) trace_span("io", name, _wall, wall, arg);
+        const auto cpu = process_cpu_time();
+        const auto hw = read_hw_counters();
+        st.wall = wall - _wall;
+        st.cpu = cpu - _cpu;
+        st.hw = hw_delta(hw, _hw);
+        _wall = wall;
+        _cpu = cpu;
+        _hw = hw;
+      }
+    };
+  }
+}
@@ -0,0 +1,144 @@
+/**********************************************
+ *   class: zsdatab::intern::substring_searcher
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "strsearch.hpp"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# define ZSDA_X86_KERNELS
+# include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace zsdatab {
+  namespace intern {
+    namespace {
+      // needles of at least this length use Boyer-Moore-Horspool
+      constexpr size_t bmh_min_needle = 32;
+
+      // memchr for the first byte (libc memchr is vectorized), then memcmp
+      size_t find_scalar(const char *h, const size_t n, const char *nd, const size_t k) noexcept {
+        if(n < k) return string::npos;
+        const char *p = h;
+        const char *const end = h + n - k + 1;
+        while(p < end) {
+          p = static_cast<const char *>(memchr(p, nd[0], end - p));
+          if(!p) break;
+          if(!memcmp(p + 1, nd + 1, k - 1)) return p - h;
+          ++p;
+        }
+        return string::npos;
+      }
+
+#ifdef ZSDA_X86_KERNELS
+      // candidates = positions where the first and the last needle byte match
+      __attribute__((target("sse2")))
+      size_t find_sse2(const char *h, const size_t n, const char *nd, const size_t k) noexcept {
+        const __m128i first = _mm_set1_epi8(nd[0]), last = _mm_set1_epi8(nd[k - 1]);
+        size_t i = 0;
+        for(; i + k + 15 <= n; i += 16) {
+          const __m128i bf = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i));
+          const __m128i bl = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i + k - 1));
+          unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+          while(mask) {
+            const unsigned b = __builtin_ctz(mask);
+            if(!memcmp(h + i + b + 1, nd + 1, k - 2)) return i + b;
+            mask &= mask - 1;
+          }
+        }
+        const size_t r = find_scalar(h + i, n - i, nd, k);
+        return (r == string::npos) ? r : (i + r);
+      }
+
+      __attribute__((target("avx2")))
+      size_t find_avx2(const char *h, const size_t n, const char *nd, const size_t k) noexcept {
+        const __m256i first = _mm256_set1_epi8(nd[0]), last = _mm256_set1_epi8(nd[k - 1]);
+        size_t i = 0;
+        for(; i + k + 31 <= n; i += 32) {
+          const __m256i bf = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(h + i));
+          const __m256i bl = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(h + i + k - 1));
+          unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(bf, first), _mm256_cmpeq_epi8(bl, last)));
+          while(mask) {
+            const unsigned b = __builtin_ctz(mask);
+            if(!memcmp(h + i + b + 1, nd + 1, k - 2)) return i + b;
+            mask &= mask - 1;
+          }
+        }
+        // the rest is shorter than 2 blocks
+        const size_t r = find_sse2(h + i, n - i, nd, k);
+        return (r == string::npos) ? r : (i + r);
+      }
+#endif
+
+      struct kernel {
+        substring_searcher::find_fn fn;
+        const char *name;
+      };
+
+      kernel select_kernel() noexcept {
+#ifdef ZSDA_X86_KERNELS
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) return {find_avx2, "avx2"};
+        if(__builtin_cpu_supports("sse2")) return {find_sse2, "sse2"};
+#endif
+        return {find_scalar, "scalar"};
+      }
+
+      const kernel &get_kernel() noexcept {
+        static const kernel ret = select_kernel();
+        return ret;
+      }
+
+      size_t find_bmh(const char *h, const size_t n, const string &nd, const vector<size_t> &skip) noexcept {
+        const size_t k = nd.size();
+        if(n < k) return string::npos;
+        const unsigned char last = nd[k - 1];
+        for(size_t i = 0; i <= n - k;) {
+          const unsigned char c = h[i + k - 1];
+          if(c == last && !memcmp(h + i, nd.data(), k - 1)) return i;
+          i += skip[c];
+        }
+        return string::npos;
+      }
+    }
+
+    substring_searcher::substring_searcher(string needle)
+      : _needle(move(needle)), _fn(get_kernel().fn)
+    {
+      const size_t k = _needle.size();
+      if(k < bmh_min_needle) return;
+      _skip.assign(256, k);
+      for(size_t j = 0; j + 1 < k; ++j)
+        _skip[static_cast<unsigned char>(_needle[j])] = k - 1 - j;
+    }
+
+    auto substring_searcher::find(const char *hay, const size_t n, const size_t from) const noexcept -> size_t {
+      const size_t k = _needle.size();
+      if(from > n) return string::npos;
+      if(!k) return from;
+      if(n - from < k) return string::npos;
+
+      const char *const h = hay + from;
+      const size_t hn = n - from;
+      size_t r;
+      if(k == 1) {
+        const void *p = memchr(h, _needle[0], hn);
+        r = p ? (static_cast<const char *>(p) - h) : string::npos;
+      } else if(!_skip.empty()) {
+        r = find_bmh(h, hn, _needle, _skip);
+      } else {
+        r = _fn(h, hn, _needle.data(), k);
+      }
+      return (r == string::npos) ? r : (from + r);
+    }
+
+    auto substring_kernel() noexcept -> const char* {
+      return get_kernel().name;
+    }
+  }
+}
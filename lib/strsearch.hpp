@@ -0,0 +1,50 @@
+/**********************************************
+ *  header: zsdatab::intern::substring_searcher
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace zsdatab {
+  namespace intern {
+    /* substring_searcher - precomputed substring search for a fixed needle
+     *
+     * short needles use a SIMD kernel (AVX2/SSE2, selected at runtime, with a
+     * scalar fallback), which tests the first and last needle byte at 16/32
+     * positions at once and only compares the candidates;
+     * long needles use Boyer-Moore-Horspool
+     */
+    class substring_searcher final {
+     public:
+      typedef size_t (*find_fn)(const char *hay, const size_t n, const char *needle, const size_t k) noexcept;
+
+      explicit substring_searcher(std::string needle);
+
+      // find - get the position of the first match at or after from (or string::npos)
+      auto find(const char *hay, const size_t n, const size_t from = 0) const noexcept -> size_t;
+
+      auto find(const std::string &hay, const size_t from = 0) const noexcept -> size_t
+        { return find(hay.data(), hay.size(), from); }
+
+      bool in(const std::string &hay) const noexcept
+        { return find(hay) != std::string::npos; }
+
+      auto needle() const noexcept -> const std::string&
+        { return _needle; }
+
+     private:
+      std::string _needle;
+      find_fn _fn;
+      // Boyer-Moore-Horspool shift table (only for long needles)
+      std::vector<size_t> _skip;
+    };
+
+    // name of the SIMD kernel selected for this CPU ("avx2", "sse2" or "scalar")
+    auto substring_kernel() noexcept -> const char*;
+  }
+}
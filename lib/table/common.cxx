@@ -6,11 +6,16 @@
  ***************************************************/
 
 #include "table/common.hpp"
+#include "instrument.hpp"
+#include "parse.hpp"
+#include "stopwatch.hpp"
 
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <cstdint>
 #include <iostream>
 #include <thread>
 
@@ -18,6 +23,38 @@ using namespace std;
 
 namespace zsdatab {
   namespace intern {
+    auto cache_mutex(const void *obj) noexcept -> mutex& {
+      static mutex locks[64];
+      return locks[(reinterpret_cast<uintptr_t>(obj) >> 4) % 64];
+    }
+
+    auto table_rows_common::data() const -> const buffer_t& {
+      // concurrent const calls fill the cache once
+      lock_guard<mutex> lock(cache_mutex(this));
+      if(!_cache) {
+        auto tmp = make_shared<buffer_t>();
+        tmp->reserve(_rows->size());
+        for(const auto &i : *_rows)
+          tmp->emplace_back(*i);
+        _cache = move(tmp);
+      }
+      return *_cache;
+    }
+
+    auto table_impl_common::data_move_out() && -> buffer_t&& {
+      // rows which aren't shared are moved
+      auto tmp = make_shared<buffer_t>();
+      tmp->reserve(_rows->size());
+      const bool uniq = (_rows.use_count() == 1);
+      for(const auto &i : *_rows) {
+        if(uniq && i.use_count() == 1) tmp->emplace_back(move(const_cast<row_t&>(*i)));
+        else                           tmp->emplace_back(*i);
+      }
+      set_rows(make_shared<row_store>());
+      _cache = tmp;
+      return move(*tmp);
+    }
+
     permanent_table_common::permanent_table_common()
       : _valid(false), _modified(false) { }
 
@@ -35,8 +72,10 @@ namespace zsdatab {
 
       _path += '.' + to_string(getpid());
 
+      stopwatch sw;
       struct stat st;
       bool fi = true;
+      size_t attempts = 1;
       while(
                 !::link(name.c_str(), _path.c_str())
              && (
@@ -50,8 +89,21 @@ namespace zsdatab {
         fi = false;
         cerr << '.';
         this_thread::yield();
+        ++attempts;
       }
       if(!fi) cerr << '\n';
+      sw.lap(_io.lock_wait, "lock wait", {"attempts", attempts});
+    }
+
+    void permanent_table_common::load_rows(istream &in) {
+      stopwatch sw;
+      const string data = read_stream(in);
+      sw.lap(_io.read, "read", {"bytes", data.size()});
+      _io.bytes_read = data.size();
+      set_rows(make_shared<row_store>(parse_rows(_meta, data.data(), data.size(), import_format::native, false)));
+      sw.lap(_io.parse);
+      _io.rows_loaded = _rows->size();
+      emit({event_type::table_open, _io.lock_wait.wall, 0, _io.rows_loaded, _io.bytes_read});
     }
 
     permanent_table_common::~permanent_table_common() {
@@ -61,7 +113,44 @@ namespace zsdatab {
 
     void permanent_table_common::data(const buffer_t &n) {
       _modified = true;
-      _data = n;
+      table_impl_common::data(n);
+    }
+
+    void permanent_table_common::shared_rows(std::shared_ptr<const row_store> n) {
+      _modified = true;
+      table_impl_common::shared_rows(move(n));
+    }
+
+    bool permanent_table_common::sync() {
+      if(!good() || !_modified || _path.empty()) return true;
+
+      trace_scope ts("io", "write back");
+      stopwatch sw;
+      string data;
+      try {
+        data = serialize_rows(_meta, *_rows);
+      } catch(const exception &e) {
+        cerr << "libzsdatable.so: ERROR: zsdatab::intern::permanent_table_common::sync() failed: corrupt table data\n"
+                "  failure detected in: " << e.what() << '\n';
+        return false;
+      }
+      sw.lap(_io.serialize, "serialize", {"rows", _rows->size()});
+
+      if(!write_back(data)) return false;
+      sw.lap(_io.write, "write", {"bytes", data.size()});
+      _io.bytes_written = data.size();
+
+      // the lock link refers to the table file
+      const int fd = ::open(_path.c_str(), O_WRONLY | O_CLOEXEC);
+      if(fd != -1) {
+        ::fsync(fd);
+        ::close(fd);
+      }
+      sw.lap(_io.fsync, "fsync");
+      emit({event_type::write_back, _io.serialize.wall + _io.write.wall + _io.fsync.wall, 0, 0, _io.bytes_written});
+
+      _modified = false;
+      return true;
     }
 
     auto permanent_table_common::clone() const -> std::shared_ptr<table_interface> {
@@ -70,7 +159,7 @@ namespace zsdatab {
 
     bool table_ref_common::good() const noexcept {
       // check for matching column count
-      return (_data.empty() || get_metadata().get_field_count() == _data.front().size());
+      return (_rows->empty() || get_metadata().get_field_count() == _rows->front()->size());
     }
 
     auto table_ref_common::data_move_out() && -> buffer_t&& {
@@ -81,12 +170,16 @@ namespace zsdatab {
       throw logic_error(__PRETTY_FUNCTION__);
     }
 
+    void table_ref_common::shared_rows(std::shared_ptr<const row_store>) {
+      throw logic_error(__PRETTY_FUNCTION__);
+    }
+
     auto table_ref::clone() const -> std::shared_ptr<table_interface> {
-      return make_shared<table_ref>(_meta, _data);
+      return make_shared<table_ref>(_meta, _rows);
     }
 
     auto table_data_ref::clone() const -> std::shared_ptr<table_interface> {
-      return make_shared<table_data_ref>(_meta, _data);
+      return make_shared<table_data_ref>(_meta, _rows);
     }
   }
 }
@@ -6,31 +6,89 @@
  **********************************************/
 #pragma once
 #include "zsdatable.hpp"
+#include <mutex>
 namespace zsdatab {
   namespace intern {
-    class table_impl_common : public table_interface {
+    // cache_mutex - lock for filling the data() buffer of obj (shared by a few objects)
+    auto cache_mutex(const void *obj) noexcept -> std::mutex&;
+
+    // make_row_store - convert a buffer into shared rows
+    static inline auto make_row_store(buffer_t &&buf) -> std::shared_ptr<const row_store> {
+      auto ret = std::make_shared<row_store>();
+      ret->reserve(buf.size());
+      for(auto &i : buf)
+        ret->emplace_back(std::make_shared<row_t>(std::move(i)));
+      return ret;
+    }
+
+    // share_rows - collect the (shared) rows of a view into a new store
+    static inline auto share_rows(const row_view &rows) -> std::shared_ptr<row_store> {
+      auto ret = std::make_shared<row_store>();
+      ret->reserve(rows.size());
+      for(size_t i = 0; i < rows.size(); ++i)
+        ret->emplace_back(rows.share(i));
+      return ret;
+    }
+
+    // cow_row - copy on write for a single row
+    static inline auto cow_row(row_ptr &p) -> row_t& {
+      if(p.use_count() != 1)
+        p = std::make_shared<row_t>(*p);
+      // row_ptr's always point to non-const rows
+      return const_cast<row_t&>(*p);
+    }
+
+    // base class for tables, which hold their rows in a (shared) row_store
+    class table_rows_common : public table_interface {
+     public:
+      table_rows_common()
+        : _rows(std::make_shared<row_store>()) { }
+      explicit table_rows_common(std::shared_ptr<const row_store> n)
+        : _rows(std::move(n)) { }
+      virtual ~table_rows_common() noexcept = default;
+
+      auto get_const_table() const noexcept -> const table_interface& final
+        { return *this; }
+      auto rows() const noexcept -> row_view final
+        { return *_rows; }
+      // NOTE: data() copies the rows into a buffer (once)
+      auto data() const -> const buffer_t& final;
+      auto shared_rows() const -> std::shared_ptr<const row_store> final
+        { return _rows; }
+
+     protected:
+      std::shared_ptr<const row_store> _rows;
+      mutable std::shared_ptr<const buffer_t> _cache;
+
+      void set_rows(std::shared_ptr<const row_store> n) noexcept {
+        _rows = std::move(n);
+        _cache.reset();
+      }
+    };
+
+    class table_impl_common : public table_rows_common {
      public:
       table_impl_common() = default;
       explicit table_impl_common(metadata o)
         : _meta(std::move(o)) { }
       table_impl_common(metadata m, buffer_t n)
-        : _meta(std::move(m)), _data(std::move(n)) { }
+        : table_rows_common(make_row_store(std::move(n))), _meta(std::move(m)) { }
+      table_impl_common(metadata m, std::shared_ptr<const row_store> n)
+        : table_rows_common(std::move(n)), _meta(std::move(m)) { }
       virtual ~table_impl_common() noexcept = default;
 
       auto get_metadata() const noexcept -> const metadata& final
         { return _meta; }
-      auto get_const_table() const noexcept -> const table_interface& final
-        { return *this; }
-      auto data() const noexcept -> const buffer_t& final
-        { return _data; }
-      auto data_move_out() && -> buffer_t&& final
-        { return std::move(_data); }
+      auto data_move_out() && -> buffer_t&& final;
+      using table_rows_common::data;
       void data(const buffer_t &n)
-        { _data = n; }
+        { set_rows(make_row_store(buffer_t(n))); }
+      using table_rows_common::shared_rows;
+      void shared_rows(std::shared_ptr<const row_store> n)
+        { set_rows(std::move(n)); }
 
      protected:
       metadata _meta;
-      buffer_t _data;
     };
 
     class permanent_table_common : public table_impl_common {
@@ -44,39 +102,49 @@ namespace zsdatab {
 
       using table_impl_common::data;
       void data(const buffer_t &n) final;
+      using table_impl_common::shared_rows;
+      void shared_rows(std::shared_ptr<const row_store> n) final;
       auto clone() const -> std::shared_ptr<table_interface> final;
+      // sync = serialize + write_back + fsync
+      bool sync() final;
+      auto get_io_stats() const noexcept -> io_stats final
+        { return _io; }
 
      protected:
       bool _valid, _modified;
       std::string _path;
+      io_stats _io;
+
+      // load_rows - read and parse the rest of in
+      void load_rows(std::istream &in);
+
+      // write_back - write the table file, data = the serialized rows (called by sync)
+      virtual bool write_back(const std::string &data) const noexcept = 0;
     };
 
-    class table_ref_common : public table_interface {
+    // read-only tables
+    class table_ref_common : public table_rows_common {
      public:
-      table_ref_common(const buffer_t &n): _data(n) { }
+      explicit table_ref_common(std::shared_ptr<const row_store> n)
+        : table_rows_common(std::move(n)) { }
       virtual ~table_ref_common() noexcept = default;
 
       bool good() const noexcept final;
 
-      auto get_const_table() const noexcept -> const table_interface& final
-        { return *this; }
-      auto data() const noexcept -> const buffer_t& final
-        { return _data; }
-
-      // this function will always throw a logic_error
+      // these functions will always throw a logic_error
+      using table_rows_common::data;
       void data(const buffer_t &n) final;
+      using table_rows_common::shared_rows;
+      void shared_rows(std::shared_ptr<const row_store> n) final;
       auto data_move_out() && -> buffer_t&& final;
-
-     protected:
-      const buffer_t &_data;
     };
 
     class table_ref final : public table_ref_common {
       const metadata &_meta;
 
      public:
-      table_ref(const metadata &m, const buffer_t &n)
-        : table_ref_common(n), _meta(m) { }
+      table_ref(const metadata &m, std::shared_ptr<const row_store> n)
+        : table_ref_common(std::move(n)), _meta(m) { }
 
       auto get_metadata() const noexcept -> const metadata&
         { return _meta; }
@@ -84,16 +152,16 @@ namespace zsdatab {
       auto clone() const -> std::shared_ptr<table_interface>;
     };
 
-    static inline table make_table_ref(const metadata &m, const buffer_t &n) {
-      return table(std::make_shared<table_ref>(m, n));
+    static inline table make_table_ref(const metadata &m, std::shared_ptr<const row_store> n) {
+      return table(std::make_shared<table_ref>(m, std::move(n)));
     }
 
     class table_data_ref final : public table_ref_common {
       metadata _meta;
 
      public:
-      table_data_ref(metadata m, const buffer_t &n)
-        : table_ref_common(n), _meta(std::move(m)) { }
+      table_data_ref(metadata m, std::shared_ptr<const row_store> n)
+        : table_ref_common(std::move(n)), _meta(std::move(m)) { }
 
       virtual ~table_data_ref() noexcept = default;
 
@@ -103,8 +171,8 @@ namespace zsdatab {
       auto clone() const -> std::shared_ptr<table_interface>;
     };
 
-    static inline table make_table_data_ref(metadata m, const buffer_t &n) {
-      return table(std::make_shared<table_data_ref>(std::move(m), n));
+    static inline table make_table_data_ref(metadata m, std::shared_ptr<const row_store> n) {
+      return table(std::make_shared<table_data_ref>(std::move(m), std::move(n)));
     }
   }
 }
@@ -6,6 +6,7 @@
  **********************************************/
 
 #include "common.hpp"
+#include <algorithm>
 #include <fstream>
 #include <iostream> // cerr
 
@@ -31,35 +32,35 @@ namespace zsdatab {
         {
           ifstream in(_path.c_str());
           if(!in) _valid = false;
-          else {
-            // use an in-memory table to get input, copy to _data
-            table tmpt(_meta);
-            in >> tmpt;
-            _data = move(tmpt).data_move_out();
-          }
+          else load_rows(in);
         }
       }
 
       ~permanent_table() noexcept {
-        if(good() && _modified && !_path.empty()) {
-#define FETPF "libzsdatable.so: ERROR: zsdatab::intern::permanent_table::~permanent_table() (write) failed: "
-          try {
-            ofstream out(_path.c_str());
-            if(!out)
-              cerr << FETPF << "table open failed\n";
-            else
-              out << make_table_ref(_meta, data());
-          } catch(const length_error &e) {
-            cerr << FETPF << "corrupt table data\n"
-                    "  failure detected in: " << e.what() << '\n';
-          } catch(const exception &e) {
-            cerr << FETPF << "unknown error\n"
-                    "  failure detected in: " << e.what() << '\n';
-          } catch(...) {
-            cerr << FETPF << "unknown error - untraceable\n";
+        sync();
+      }
+
+     private:
+      bool write_back(const string &data) const noexcept {
+#define FETPF "libzsdatable.so: ERROR: zsdatab::intern::permanent_table::write_back() failed: "
+        try {
+          ofstream out(_path.c_str());
+          if(!out)
+            cerr << FETPF << "table open failed\n";
+          else {
+            out.write(data.data(), data.size());
+            out.close();
+            if(out.good()) return true;
+            cerr << FETPF << "write failed\n";
           }
-#undef FETPF
+        } catch(const exception &e) {
+          cerr << FETPF << "unknown error\n"
+                  "  failure detected in: " << e.what() << '\n';
+        } catch(...) {
+          cerr << FETPF << "unknown error - untraceable\n";
         }
+#undef FETPF
+        return false;
       }
     };
 
@@ -71,7 +72,7 @@ namespace zsdatab {
       }
 
       auto clone() const -> std::shared_ptr<table_interface> {
-        return make_shared<in_memory_table>(_meta, _data);
+        return make_shared<in_memory_table>(_meta, _rows);
       }
     };
   }
@@ -89,13 +90,26 @@ namespace zsdatab {
 
   void table::data(const buffer_t &n) {
     // copy on write
-    if(n != _t->data()) {
+    const auto cur = _t->rows();
+    if(n.size() != cur.size() || !equal(n.begin(), n.end(), cur.begin())) {
       if(!experimental::get_underlying(_t).unique())
         _t = _t->clone();
       _t->data(n);
     }
   }
 
+  void table::shared_rows(std::shared_ptr<const row_store> n) {
+    const auto cur = _t->shared_rows();
+    if(n == cur || (n->size() == cur->size() && equal(n->begin(), n->end(), cur->begin(),
+         [](const row_ptr &a, const row_ptr &b) noexcept { return a == b || *a == *b; })))
+      return;
+
+    // copy on write
+    if(!experimental::get_underlying(_t).unique())
+      _t = _t->clone();
+    _t->shared_rows(move(n));
+  }
+
   auto table::clone() const -> std::shared_ptr<table_interface> {
     return _t->clone();
   }
@@ -19,33 +19,35 @@ namespace zsdatab {
           _valid = !_meta.empty();
 
         }
-        if(_valid) {
-          table tmpt(_meta);
-          in >> tmpt;
-          _data = std::move(tmpt).data_move_out();
-        }
+        if(_valid) load_rows(in);
       }
 
       ~packed_table_common() noexcept {
-        if(good() && _modified && !_path.empty()) {
-#define FETPF "libzsdatable.so: ERROR: zsdatab::packed_table_common::~packed_table_common() (write) failed: "
-          try {
-            Tostream out(_path.c_str());
-            if(!out)
-              std::cerr << FETPF << "table open failed\n";
-            else
-              out << _meta << make_table_ref(_meta, data());
-          } catch(const std::length_error &e) {
-            std::cerr << FETPF << "corrupt table data\n"
-                "  failure detected in: " << e.what() << '\n';
-          } catch(const std::exception &e) {
-            std::cerr << FETPF << "unknown error\n"
-                "  failure detected in: " << e.what() << '\n';
-          } catch(...) {
-            std::cerr << FETPF << "unknown error - untraceable\n";
+        sync();
+      }
+
+     private:
+      bool write_back(const std::string &data) const noexcept {
+#define FETPF "libzsdatable.so: ERROR: zsdatab::packed_table_common::write_back() failed: "
+        try {
+          Tostream out(_path.c_str());
+          if(!out)
+            std::cerr << FETPF << "table open failed\n";
+          else {
+            out << _meta;
+            out.write(data.data(), data.size());
+            out.close();
+            if(out.good()) return true;
+            std::cerr << FETPF << "write failed\n";
           }
-#undef FETPF
+        } catch(const std::exception &e) {
+          std::cerr << FETPF << "unknown error\n"
+              "  failure detected in: " << e.what() << '\n';
+        } catch(...) {
+          std::cerr << FETPF << "unknown error - untraceable\n";
         }
+#undef FETPF
+        return false;
       }
     };
 
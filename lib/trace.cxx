@@ -0,0 +1,244 @@
+/**********************************************
+ *  object: zsdatab::start_trace
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "trace.hpp"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace zsdatab {
+  namespace intern {
+    atomic<bool> trace_enabled{false};
+
+    namespace {
+      // events per thread and trace, more are dropped
+      constexpr size_t max_thread_events = 0x100000;
+
+      struct trace_event {
+        const char *cat, *name;
+        char ph; // X = span, C = counter
+        int64_t start, dur;
+        trace_arg args[3];
+      };
+
+      // thread_buf - the events of one thread
+      struct thread_buf {
+        mutex mtx;
+        unsigned tid;
+        string name;
+        vector<trace_event> events;
+        size_t dropped = 0;
+      };
+
+      // thread_events - the events of a thread taken by stop_trace
+      struct thread_events {
+        unsigned tid;
+        string name;
+        vector<trace_event> events;
+      };
+
+      struct trace_state {
+        mutex mtx;
+        vector<shared_ptr<thread_buf>> bufs;
+        string path;
+        int64_t origin = 0;
+        unsigned next_tid = 1;
+      };
+
+      trace_state &get_trace() {
+        static trace_state ret;
+        return ret;
+      }
+
+      thread_local string own_name;
+      thread_local shared_ptr<thread_buf> own_buf;
+
+      inline int64_t to_ns(const trace_time t) noexcept {
+        return chrono::duration_cast<chrono::nanoseconds>(t.time_since_epoch()).count();
+      }
+
+      auto own() noexcept -> thread_buf* {
+        if(!own_buf) {
+          try {
+            auto b = make_shared<thread_buf>();
+            auto &st = get_trace();
+            lock_guard<mutex> lock(st.mtx);
+            b->tid = st.next_tid++;
+            b->name = own_name.empty() ? ("thread " + to_string(b->tid)) : own_name;
+            st.bufs.push_back(b);
+            own_buf = move(b);
+          } catch(...) {
+            return nullptr;
+          }
+        }
+        return own_buf.get();
+      }
+
+      void record(const trace_event &ev) noexcept {
+        const auto b = own();
+        if(!b) return;
+        lock_guard<mutex> lock(b->mtx);
+        if(b->events.size() >= max_thread_events) {
+          ++b->dropped;
+          return;
+        }
+        try {
+          b->events.push_back(ev);
+        } catch(...) {
+          ++b->dropped;
+        }
+      }
+
+      string json_string(const string &s) {
+        string ret = "\"";
+        for(const char c : s) {
+          if(c == '"' || c == '\\') {
+            ret += '\\';
+            ret += c;
+          } else if(static_cast<unsigned char>(c) < 0x20) {
+            char tmp[8];
+            snprintf(tmp, sizeof(tmp), "\\u%04x", c);
+            ret += tmp;
+          } else {
+            ret += c;
+          }
+        }
+        return ret + '"';
+      }
+
+      // us - ns as microseconds with 3 decimals
+      string us(const int64_t ns) {
+        char tmp[32];
+        snprintf(tmp, sizeof(tmp), "%.3f", ns / 1e3);
+        return tmp;
+      }
+
+      /* write_trace - Chrome trace event format (JSON object format)
+       * times are in microseconds since start_trace
+       */
+      bool write_trace(const string &path, const int64_t origin, const vector<thread_events> &bufs, const size_t dropped) {
+        ofstream out(path);
+        if(!out) return false;
+        const int pid = getpid();
+        const char *sep = "\n";
+        out << "{\"traceEvents\":[";
+        for(const auto &i : bufs) {
+          if(i.events.empty()) continue;
+          out << sep << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << i.tid
+              << ",\"args\":{\"name\":" << json_string(i.name) << "}}";
+          sep = ",\n";
+          for(const auto &e : i.events) {
+            // spans which started before the trace
+            if(e.start < origin) continue;
+            out << sep << "{\"name\":\"" << e.name;
+            if(e.ph == 'C') {
+              out << "\",\"ph\":\"C\",\"ts\":" << us(e.start - origin) << ",\"pid\":" << pid << ",\"tid\":" << i.tid
+                  << ",\"args\":{\"value\":" << static_cast<long long>(e.args[0].value) << "}}";
+              continue;
+            }
+            out << "\",\"cat\":\"" << e.cat << "\",\"ph\":\"X\",\"ts\":" << us(e.start - origin) << ",\"dur\":" << us(e.dur)
+                << ",\"pid\":" << pid << ",\"tid\":" << i.tid << ",\"args\":{";
+            const char *asep = "";
+            for(const auto &a : e.args) {
+              if(!a.name) continue;
+              out << asep << '"' << a.name << "\":" << a.value;
+              asep = ",";
+            }
+            out << "}}";
+          }
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":\"" << dropped << "\"}}\n";
+        out.close();
+        return out.good();
+      }
+
+      // $ZSDATAB_TRACE = FILE: trace the whole process
+      struct env_trace {
+        bool started = false;
+
+        env_trace() {
+          const char *env = getenv("ZSDATAB_TRACE");
+          if(env && *env) started = start_trace(env);
+        }
+
+        ~env_trace() {
+          if(started) stop_trace();
+        }
+      } env_trace_inst;
+    }
+
+    void trace_span(const char *cat, const char *name, const trace_time start, const trace_time end,
+                    const trace_arg a0, const trace_arg a1, const trace_arg a2) noexcept {
+      if(!tracing()) return;
+      const int64_t s = to_ns(start);
+      record({cat, name, 'X', s, to_ns(end) - s, {a0, a1, a2}});
+    }
+
+    void trace_counter(const char *name, const int64_t value) noexcept {
+      if(!tracing()) return;
+      record({"", name, 'C', to_ns(chrono::steady_clock::now()), 0, {{"value", static_cast<uint64_t>(value)}, {}, {}}});
+    }
+
+    void trace_thread_name(string name) noexcept {
+      own_name.swap(name);
+      if(own_buf) {
+        lock_guard<mutex> lock(own_buf->mtx);
+        own_buf->name = own_name;
+      }
+    }
+  }
+
+  bool start_trace(const string &path) {
+    auto &st = intern::get_trace();
+    lock_guard<mutex> lock(st.mtx);
+    if(intern::trace_enabled.load()) return false;
+    st.path = path;
+    st.origin = intern::to_ns(chrono::steady_clock::now());
+    // events of spans which ended after the last stop_trace
+    for(const auto &i : st.bufs) {
+      lock_guard<mutex> lock2(i->mtx);
+      i->events.clear();
+      i->dropped = 0;
+    }
+    intern::trace_enabled.store(true);
+    return true;
+  }
+
+  bool stop_trace() {
+    auto &st = intern::get_trace();
+    vector<intern::thread_events> bufs;
+    size_t dropped = 0;
+    string path;
+    int64_t origin;
+    {
+      lock_guard<mutex> lock(st.mtx);
+      if(!intern::trace_enabled.exchange(false)) return false;
+      path = st.path;
+      origin = st.origin;
+      bufs.reserve(st.bufs.size());
+      for(const auto &i : st.bufs) {
+        lock_guard<mutex> lock2(i->mtx);
+        bufs.push_back({i->tid, i->name, move(i->events)});
+        i->events.clear();
+        dropped += i->dropped;
+        i->dropped = 0;
+      }
+      // buffers of exited threads
+      for(auto it = st.bufs.begin(); it != st.bufs.end();)
+        it = (it->use_count() == 1) ? st.bufs.erase(it) : (it + 1);
+    }
+    return intern::write_trace(path, origin, bufs, dropped);
+  }
+}
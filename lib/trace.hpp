@@ -0,0 +1,62 @@
+/**********************************************
+ *  header: zsdatab::intern::trace_scope
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+#pragma once
+#include "zsdatable.hpp"
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace zsdatab {
+  namespace intern {
+    // set by start_trace
+    extern std::atomic<bool> trace_enabled;
+
+    typedef std::chrono::steady_clock::time_point trace_time;
+
+    inline bool tracing() noexcept
+      { return trace_enabled.load(std::memory_order_relaxed); }
+
+    struct trace_arg {
+      const char *name;
+      std::uint64_t value;
+    };
+
+    /* trace_span - record a span of the calling thread
+     * cat, name and the argument names have to be string literals
+     */
+    void trace_span(const char *cat, const char *name, trace_time start, trace_time end,
+                    trace_arg a0 = {}, trace_arg a1 = {}, trace_arg a2 = {}) noexcept;
+
+    // trace_counter - record a value of a counter (a graph in the viewer)
+    void trace_counter(const char *name, std::int64_t value) noexcept;
+
+    // trace_thread_name - name the calling thread in traces
+    void trace_thread_name(std::string name) noexcept;
+
+    // trace_scope - a span from the construction to the destruction (if tracing at construction)
+    class trace_scope final {
+      const char *const _cat, *const _name;
+      trace_arg _arg{};
+      trace_time _start;
+      const bool _on;
+
+     public:
+      trace_scope(const char *cat, const char *name) noexcept
+        : _cat(cat), _name(name), _on(tracing())
+      {
+        if(_on) _start = std::chrono::steady_clock::now();
+      }
+
+      ~trace_scope() noexcept {
+        if(_on) trace_span(_cat, _name, _start, std::chrono::steady_clock::now(), _arg);
+      }
+
+      void arg(const char *name, const std::uint64_t value) noexcept
+        { _arg = {name, value}; }
+    };
+  }
+}
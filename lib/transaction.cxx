@@ -6,6 +6,7 @@
  **********************************************/
 
 #include "zsdatable.hpp"
+#include "trace.hpp"
 
 using namespace std;
 
@@ -16,9 +17,12 @@ namespace zsdatab {
       enum action_name {
         NONE,        APPEND,
         CLEAR, SORT, UNIQ, NEGATE,
-        FILTER,      SET_FIELD,
+        DISTINCT,    FILTER,
+        SORT_BY,     LIMIT,
+        TOP_K,       FILTER_CHAIN,
+        FILTER_EXPR, SET_FIELD,
         APPEND_PART, REMOVE_PART,
-        REPLACE_PART
+        REPLACE_PART, UPDATE_WHERE
       };
       }
 
@@ -51,20 +55,62 @@ namespace zsdatab {
         action_name get_name() const noexcept { return action_name::SORT;          }
       };
 
+      struct sort_by final : action {
+        void apply(context_common &ctx) const { ctx.sort(cols, stable);            }
+        action_name get_name() const noexcept { return action_name::SORT_BY;       }
+        sort_columns cols;
+        bool stable;
+      };
+
       struct uniq final : action {
         void apply(context_common &ctx) const { ctx.uniq();                        }
         action_name get_name() const noexcept { return action_name::UNIQ;          }
       };
 
+      struct distinct final : action {
+        void apply(context_common &ctx) const { ctx.distinct();                    }
+        action_name get_name() const noexcept { return action_name::DISTINCT;      }
+      };
+
       struct negate final : action {
         void apply(context_common &ctx) const { ctx.negate();                      }
         action_name get_name() const noexcept { return action_name::NEGATE;        }
       };
 
       struct filter final : akv {
-        void apply(context_common &ctx) const { ctx.filter(field, value, whole);   }
+        void apply(context_common &ctx) const { ctx.filter(field, value, whole, false, limit); }
         action_name get_name() const noexcept { return action_name::FILTER;        }
         bool whole;
+        size_t limit = string::npos;
+      };
+
+      // fused filters, only created by the planner
+      struct filter_chain final : action {
+        void apply(context_common &ctx) const { ctx.filter(terms, limit);          }
+        action_name get_name() const noexcept { return action_name::FILTER_CHAIN;  }
+        vector<filter_term> terms;
+        size_t limit = string::npos;
+      };
+
+      struct filter_expr final : action {
+        explicit filter_expr(predicate p): pred(move(p)) { }
+        void apply(context_common &ctx) const { ctx.filter(pred, limit);           }
+        action_name get_name() const noexcept { return action_name::FILTER_EXPR;   }
+        predicate pred;
+        size_t limit = string::npos;
+      };
+
+      struct limit final : action {
+        void apply(context_common &ctx) const { ctx.limit(n);                      }
+        action_name get_name() const noexcept { return action_name::LIMIT;         }
+        size_t n;
+      };
+
+      struct top_k final : action {
+        void apply(context_common &ctx) const { ctx.top_k(cols, k);                }
+        action_name get_name() const noexcept { return action_name::TOP_K;         }
+        sort_columns cols;
+        size_t k;
       };
 
       struct set_field final : akv {
@@ -90,6 +136,14 @@ namespace zsdatab {
         size_t field;
       };
 
+      struct update_where final : action {
+        update_where(predicate p, mutation_spec m): pred(move(p)), muts(move(m)) { }
+        void apply(context_common &ctx) const { ctx.update_where(pred, muts);      }
+        action_name get_name() const noexcept { return action_name::UPDATE_WHERE;  }
+        predicate pred;
+        mutation_spec muts;
+      };
+
       typedef vector<shared_ptr<action>> actions_t;
 
       }
@@ -103,12 +157,107 @@ namespace zsdatab {
     _actions.swap(o._actions);
   }
 
+  // ta__filter_pos - get the position in front of the sort, sort_by, uniq and distinct actions at the end of actions
+  static size_t ta__filter_pos(const intern::ta::actions_t &actions) noexcept {
+    using intern::ta::action_name;
+    size_t pos = actions.size();
+    while(pos) {
+      const auto pn = actions[pos - 1]->get_name();
+      if(pn != action_name::SORT && pn != action_name::SORT_BY && pn != action_name::UNIQ && pn != action_name::DISTINCT)
+        break;
+      --pos;
+    }
+    return pos;
+  }
+
+  /* ta__plan - build the execution plan for a list of actions
+   *  - filters are moved in front of sort, sort_by, uniq and distinct
+   *    (a filter with limit stays in place)
+   *  - consecutive filters are fused into one filter_chain (one pass over the buffer),
+   *    consecutive predicate filters into one predicate
+   */
+  static auto ta__plan(const intern::ta::actions_t &actions) -> intern::ta::actions_t {
+    using namespace intern::ta;
+    actions_t ret;
+    ret.reserve(actions.size());
+
+    for(const auto &i : actions) {
+      if(i->get_name() == action_name::FILTER_EXPR) {
+        const auto f = static_cast<const filter_expr *>(i.get());
+        size_t pos = (f->limit == string::npos) ? ta__filter_pos(ret) : ret.size();
+        if(pos && ret[pos - 1]->get_name() == action_name::FILTER_EXPR) {
+          const auto old = static_cast<const filter_expr *>(ret[pos - 1].get());
+          if(old->limit == string::npos) {
+            auto p = make_shared<filter_expr>(old->pred && f->pred);
+            p->limit = f->limit;
+            ret[pos - 1] = move(p);
+            continue;
+          }
+        }
+        ret.emplace(ret.begin() + pos, i);
+        continue;
+      } else if(i->get_name() != action_name::FILTER) {
+        ret.emplace_back(i);
+        continue;
+      }
+
+      const auto f = static_cast<const intern::ta::filter *>(i.get());
+      size_t pos = (f->limit == string::npos) ? ta__filter_pos(ret) : ret.size();
+
+      shared_ptr<filter_chain> p;
+      if(pos && ret[pos - 1]->get_name() == action_name::FILTER_CHAIN) {
+        const auto old = static_cast<const filter_chain *>(ret[pos - 1].get());
+        if(old->limit == string::npos) {
+          // chains are private to the plan, so they can be modified
+          p = static_pointer_cast<filter_chain>(ret[pos - 1]);
+          --pos;
+        }
+      }
+
+      if(!p) {
+        p = make_shared<filter_chain>();
+        ret.emplace(ret.begin() + pos, p);
+      }
+      p->terms.push_back({f->field, f->value, f->whole, false});
+      p->limit = f->limit;
+    }
+
+    return ret;
+  }
+
+  static const char *ta__trace_name(const intern::ta::action_name n) noexcept {
+    using intern::ta::action_name;
+    switch(n) {
+      case action_name::APPEND:       return "append";
+      case action_name::CLEAR:        return "clear";
+      case action_name::SORT:         return "sort";
+      case action_name::UNIQ:         return "uniq";
+      case action_name::NEGATE:       return "negate";
+      case action_name::DISTINCT:     return "distinct";
+      case action_name::FILTER:       return "filter";
+      case action_name::SORT_BY:      return "sort_by";
+      case action_name::LIMIT:        return "limit";
+      case action_name::TOP_K:        return "top_k";
+      case action_name::FILTER_CHAIN: return "filter_chain";
+      case action_name::FILTER_EXPR:  return "filter_expr";
+      case action_name::SET_FIELD:    return "set_field";
+      case action_name::APPEND_PART:  return "append_part";
+      case action_name::REMOVE_PART:  return "remove_part";
+      case action_name::REPLACE_PART: return "replace_part";
+      case action_name::UPDATE_WHERE: return "update_where";
+      default:                        return "none";
+    }
+  }
+
   void transaction::apply(intern::context_common &ctx) const {
     if(_meta != ctx.get_metadata())
       throw invalid_argument(__PRETTY_FUNCTION__);
 
-    for(auto &&i : _actions)
+    for(auto &&i : ta__plan(_actions)) {
+      intern::trace_scope ts("transaction", ta__trace_name(i->get_name()));
       i->apply(ctx);
+      ts.arg("rows_out", ctx.count());
+    }
   }
 
   // actions
@@ -150,12 +299,49 @@ namespace zsdatab {
       case action_name::UNIQ:
         break;
 
+      case action_name::SORT_BY:
+        _actions.pop_back();
+        [[fallthrough]];
+
       default:
         _actions.emplace_back(new intern::ta::sort);
     }
     return *this;
   }
 
+  static void ta__add_sort_by(intern::ta::actions_t &actions, intern::sort_columns &&cols, const bool stable) {
+    if(cols.empty()) return;
+
+    switch(ta__get_lasta(actions)) {
+      case action_name::CLEAR:
+        return;
+
+      case action_name::SORT:
+      case action_name::SORT_BY:
+        // an unstable sort doesn't depend on the previous order
+        if(!stable) actions.pop_back();
+        break;
+
+      default:
+        break;
+    }
+
+    auto p = make_shared<intern::ta::sort_by>();
+    p->cols = move(cols);
+    p->stable = stable;
+    actions.emplace_back(move(p));
+  }
+
+  transaction& transaction::sort(const sort_spec &spec) {
+    ta__add_sort_by(_actions, intern::resolve_sort_spec(_meta, spec), false);
+    return *this;
+  }
+
+  transaction& transaction::stable_sort(const sort_spec &spec) {
+    ta__add_sort_by(_actions, intern::resolve_sort_spec(_meta, spec), true);
+    return *this;
+  }
+
   transaction& transaction::uniq() {
     switch(ta__get_lasta(_actions)) {
       case action_name::CLEAR:
@@ -163,6 +349,8 @@ namespace zsdatab {
         break;
 
       case action_name::SORT:
+      case action_name::SORT_BY:
+      case action_name::DISTINCT:
         _actions.pop_back();
         [[fallthrough]];
 
@@ -172,6 +360,24 @@ namespace zsdatab {
     return *this;
   }
 
+  transaction& transaction::distinct() {
+    switch(ta__get_lasta(_actions)) {
+      case action_name::CLEAR:
+      case action_name::UNIQ:
+      case action_name::DISTINCT:
+        break;
+
+      case action_name::SORT:
+        // sorted input: distinct == uniq
+        uniq();
+        break;
+
+      default:
+        _actions.emplace_back(new intern::ta::distinct);
+    }
+    return *this;
+  }
+
   transaction& transaction::negate() {
     switch(ta__get_lasta(_actions)) {
       case action_name::NEGATE:
@@ -179,7 +385,9 @@ namespace zsdatab {
         break;
 
       case action_name::SORT:
+      case action_name::SORT_BY:
       case action_name::UNIQ:
+      case action_name::DISTINCT:
         _actions.pop_back();
         [[fallthrough]];
 
@@ -194,7 +402,17 @@ namespace zsdatab {
     p->field = _meta.get_field_nr(field);
     p->value = value;
     p->whole = whole;
+    return add_filter(move(p));
+  }
+
+  transaction& transaction::filter(const predicate &pred) {
+    // check the field names now
+    for(const auto &i : pred.fields())
+      _meta.get_field_nr(i);
+    return add_filter(make_shared<intern::ta::filter_expr>(pred));
+  }
 
+  transaction& transaction::add_filter(std::shared_ptr<intern::ta::action> &&p) {
     switch(ta__get_lasta(_actions)) {
       case action_name::CLEAR:
         break;
@@ -209,6 +427,19 @@ namespace zsdatab {
         uniq();
         break;
 
+      case action_name::DISTINCT:
+        _actions.back() = p;
+        distinct();
+        break;
+
+      case action_name::SORT_BY:
+        {
+          auto s = move(_actions.back());
+          _actions.back() = p;
+          _actions.emplace_back(move(s));
+        }
+        break;
+
       default:
         _actions.emplace_back(p);
     }
@@ -216,6 +447,110 @@ namespace zsdatab {
     return *this;
   }
 
+  static void ta__add_top_k(intern::ta::actions_t &actions, intern::sort_columns &&cols, const size_t k) {
+    switch(ta__get_lasta(actions)) {
+      case action_name::CLEAR:
+        return;
+
+      case action_name::SORT:
+        actions.pop_back();
+        break;
+
+      case action_name::SORT_BY:
+        if(!static_cast<const intern::ta::sort_by *>(actions.back().get())->stable)
+          actions.pop_back();
+        break;
+
+      default:
+        break;
+    }
+
+    auto p = make_shared<intern::ta::top_k>();
+    p->cols = move(cols);
+    p->k = k;
+    actions.emplace_back(move(p));
+  }
+
+  transaction& transaction::top_k(const sort_spec &spec, const size_t k) {
+    ta__add_top_k(_actions, intern::resolve_sort_spec(_meta, spec), k);
+    return *this;
+  }
+
+  transaction& transaction::limit(const size_t n) {
+    switch(ta__get_lasta(_actions)) {
+      case action_name::CLEAR:
+        return *this;
+
+      case action_name::LIMIT:
+        {
+          const auto old = static_cast<const intern::ta::limit *>(_actions.back().get());
+          if(old->n <= n) return *this;
+          _actions.pop_back();
+        }
+        break;
+
+      case action_name::TOP_K:
+        {
+          const auto old = static_cast<const intern::ta::top_k *>(_actions.back().get());
+          if(old->k > n) {
+            auto cols = old->cols;
+            _actions.pop_back();
+            ta__add_top_k(_actions, move(cols), n);
+          }
+        }
+        return *this;
+
+      case action_name::SORT:
+        {
+          // sort + limit = top_k over all columns
+          intern::sort_columns cols;
+          const size_t colcnt = _meta.get_field_count();
+          cols.reserve(colcnt);
+          for(size_t i = 0; i < colcnt; ++i)
+            cols.push_back({i, asc});
+          ta__add_top_k(_actions, move(cols), n);
+        }
+        return *this;
+
+      case action_name::SORT_BY:
+        {
+          const auto old = static_cast<const intern::ta::sort_by *>(_actions.back().get());
+          if(!old->stable) {
+            ta__add_top_k(_actions, intern::sort_columns(old->cols), n);
+            return *this;
+          }
+        }
+        break;
+
+      case action_name::FILTER:
+        {
+          // stop the filter scan early
+          const auto old = static_cast<const intern::ta::filter *>(_actions.back().get());
+          auto p = make_shared<intern::ta::filter>(*old);
+          p->limit = min(p->limit, n);
+          _actions.back() = move(p);
+        }
+        return *this;
+
+      case action_name::FILTER_EXPR:
+        {
+          const auto old = static_cast<const intern::ta::filter_expr *>(_actions.back().get());
+          auto p = make_shared<intern::ta::filter_expr>(*old);
+          p->limit = min(p->limit, n);
+          _actions.back() = move(p);
+        }
+        return *this;
+
+      default:
+        break;
+    }
+
+    auto p = make_shared<intern::ta::limit>();
+    p->n = n;
+    _actions.emplace_back(move(p));
+    return *this;
+  }
+
   transaction& transaction::set_field(const string& field, const string& value) {
     if(ta__get_lasta(_actions) == action_name::CLEAR) return *this;
     const size_t fnr = _meta.get_field_nr(field);
@@ -263,7 +598,7 @@ namespace zsdatab {
   transaction& transaction::remove_part(const string& field, const string& value) {
     if(ta__get_lasta(_actions) == action_name::CLEAR) return *this;
     const size_t fnr = _meta.get_field_nr(field);
-    auto p = new intern::ta::append_part;
+    auto p = new intern::ta::remove_part;
     p->field = fnr;
     try {
       p->value = value;
@@ -272,26 +607,8 @@ namespace zsdatab {
       throw;
     }
 
-    switch(ta__get_lasta(_actions)) {
-      case action_name::APPEND_PART:
-        {
-          const auto old = dynamic_cast<const intern::ta::append_part *>(_actions.back().get());
-          if(old && old->field == fnr && old->value == value)
-            _actions.pop_back();
-        }
-        break;
-
-      case action_name::REMOVE_PART:
-        {
-          const auto old = dynamic_cast<const intern::ta::remove_part *>(_actions.back().get());
-          if(old && old->field == fnr && old->value == value)
-            _actions.pop_back();
-        }
-        break;
-
-      default:
-        break;
-    }
+    // NOTE: remove_part removes the first occurrence, so it can't be merged
+    //       with a preceding append_part or remove_part
     _actions.emplace_back(p);
     return *this;
   }
@@ -312,4 +629,16 @@ namespace zsdatab {
       throw;
     }
   }
+
+  transaction& transaction::update_where(const predicate &pred, const mutation_spec &muts) {
+    if(ta__get_lasta(_actions) == action_name::CLEAR) return *this;
+    // check the field names now
+    for(const auto &i : pred.fields())
+      _meta.get_field_nr(i);
+    for(const auto &i : muts)
+      _meta.get_field_nr(i.field);
+    if(!muts.empty())
+      _actions.emplace_back(make_shared<intern::ta::update_where>(pred, muts));
+    return *this;
+  }
 }
@@ -0,0 +1,92 @@
+/**********************************************
+ *    part: update_where
+ * library: zsdatable
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "mutation.hpp"
+#include "pool.hpp"
+#include "predicate.hpp"
+#include "table/common.hpp"
+
+#include <atomic>
+
+using namespace std;
+
+namespace zsdatab {
+  namespace intern {
+    context_common& context_common::update_where(const predicate &pred, const mutation_spec &muts) {
+      const auto &meta = get_metadata();
+      const row_matcher match(meta, pred);
+      const auto ks = compile_mutations(meta, muts);
+      if(empty() || ks.empty()) return *this;
+
+      auto &st = own();
+      parallel_for(par_op::update, st.size(), [&st, &match, &ks](const size_t b, const size_t e) {
+        for(size_t i = b; i < e; ++i)
+          if(match(*st[i]))
+            apply_mutations(ks, st[i]);
+      });
+      return *this;
+    }
+  }
+
+  auto table::update_where(const predicate &pred, const mutation_spec &muts) -> size_t {
+    const auto &meta = get_metadata();
+    const intern::row_matcher match(meta, pred);
+    const auto ks = intern::compile_mutations(meta, muts);
+
+    // only the row pointers are copied, changed rows are copied on write
+    auto store = make_shared<row_store>(*shared_rows());
+    atomic<size_t> matched(0);
+    atomic<bool> changed(false);
+    intern::parallel_for(intern::par_op::update, store->size(), [&](const size_t b, const size_t e) {
+      size_t m = 0;
+      bool c = false;
+      for(size_t i = b; i < e; ++i) {
+        auto &p = (*store)[i];
+        if(!match(*p)) continue;
+        ++m;
+        if(intern::apply_mutations(ks, p)) c = true;
+      }
+      matched += m;
+      if(c) changed = true;
+    });
+
+    if(changed) shared_rows(move(store));
+    return matched;
+  }
+
+  context& context::update(const mutation_spec &muts) {
+    const auto ks = intern::compile_mutations(get_metadata(), muts);
+    if(ks.empty() || empty()) return *this;
+
+    if(_base != _table.shared_rows()) {
+      // the selection doesn't refer to the table rows
+      context rest(*this);
+      rest.negate();
+      auto &st = own();
+      intern::parallel_for(intern::par_op::update, st.size(), [&st, &ks](const size_t b, const size_t e) {
+        for(size_t i = b; i < e; ++i)
+          intern::apply_mutations(ks, st[i]);
+      });
+      rest += *this;
+      rest.push();
+      return *this;
+    }
+
+    auto store = make_shared<row_store>(*_base);
+    const auto v = rows();
+    intern::parallel_for(intern::par_op::update, v.size(), [&store, &v, &ks](const size_t b, const size_t e) {
+      for(size_t i = b; i < e; ++i)
+        intern::apply_mutations(ks, (*store)[v.index(i)]);
+    });
+
+    // the selection (row numbers) stays valid
+    _base = move(store);
+    _cache.reset();
+    _table.shared_rows(_base);
+    return *this;
+  }
+}
@@ -0,0 +1,276 @@
+/*******************************************************************************
+ * program: zsdatab-server
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *******************************************************************************
+ * Copyright (C) 2021 zseri
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License along
+ * with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *******************************************************************************/
+
+#include "entry_common.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace zsdatab_entry;
+
+namespace {
+  int sig_pipe[2] = {-1, -1};
+
+  void on_signal(int) {
+    const char c = 0;
+    if(write(sig_pipe[1], &c, 1)) { }
+  }
+
+  // resident - a loaded (and locked) table
+  struct resident {
+    mutex mtx;
+    optional<zsdatab::table> tab;
+  };
+
+  class server {
+    int _fd;
+    mutex _mtx;
+    condition_variable _idle;
+    map<string, shared_ptr<resident>> _tables;
+    set<int> _clients;
+    bool _stop;
+
+    auto get_resident(const string &key) -> shared_ptr<resident> {
+      lock_guard<mutex> lock(_mtx);
+      auto &ret = _tables[key];
+      if(!ret) ret = make_shared<resident>();
+      return ret;
+    }
+
+    // serve - run a request on its table, the table is loaded on first use
+    int serve(const vector<string> &req, ostream &out, ostream &err) {
+      const string &mode = req[1], &path = req[3];
+      const bool gz = req[2].find('z') != string::npos;
+      const bool profile = req[2].find('p') != string::npos;
+      if((mode != "args" && mode != "script") || (mode == "script" && req.size() != 8)
+         || (!req[5].empty() && req[5].front() != '<')) {
+        err << "zsdatab-server: ERROR: invalid request\n";
+        return 1;
+      }
+
+      // the counters of concurrent requests are mixed
+      if(profile) zsdatab::enable_hw_counters();
+
+      const auto r = get_resident((gz ? "z:" : ":") + path);
+      lock_guard<mutex> lock(r->mtx);
+      const bool loaded = !r->tab;
+      if(loaded) {
+        {
+          lock_guard<mutex> lock2(_mtx);
+          if(_stop) {
+            err << "zsdatab-server: ERROR: server is shutting down\n";
+            return 1;
+          }
+        }
+        zsdatab::table t = gz ? zsdatab::make_gzipped_table(path) : zsdatab::table(path);
+        if(!t.good()) {
+          err << "zsdatab-entry: ERROR: " << path << ": file not found / read failed\n";
+          return 1;
+        }
+        r->tab.emplace(move(t));
+      }
+
+      int ret;
+      // stdin of the client
+      istringstream in(req[5].empty() ? string() : req[5].substr(1));
+      session s(*r->tab, mode == "script", out, err, req[5].empty() ? nullptr : &in);
+      s.cwd = req[4];
+      s.profile = profile;
+      if(mode == "script") {
+        istringstream script(req[7]);
+        ret = run_script(s, script, req[6]);
+      } else {
+        deque<string> commands(req.begin() + 6, req.end());
+        ret = run_args(s, commands);
+      }
+
+      // write back after every request, the table stays loaded
+      const auto prev = r->tab->get_io_stats();
+      if(!r->tab->sync()) {
+        err << "zsdatab-server: ERROR: " << path << ": write back failed\n";
+        ret = 1;
+      }
+      if(profile) print_profile(s, prev, loaded);
+      return ret;
+    }
+
+    void handle(const int fd) {
+      vector<string> req;
+      ostringstream out, err;
+      int ret = 1;
+      // invalid requests get no response
+      bool respond = false;
+      try {
+        if(read_message(fd, req, max_request_strings, max_request_size) && req.size() >= 6 && req[0] == proto_magic) {
+          respond = true;
+          ret = serve(req, out, err);
+        }
+      } catch(const exception &e) {
+        err << "zsdatab-server: ERROR: " << e.what() << '\n';
+        ret = 1;
+        respond = true;
+      }
+      if(respond) write_message(fd, {to_string(ret), out.str(), err.str()});
+
+      lock_guard<mutex> lock(_mtx);
+      _clients.erase(fd);
+      close(fd);
+      if(_clients.empty()) _idle.notify_all();
+    }
+
+   public:
+    explicit server(const int fd)
+      : _fd(fd), _stop(false) { }
+
+    void run() {
+      pollfd fds[2] = {{_fd, POLLIN, 0}, {sig_pipe[0], POLLIN, 0}};
+      for(;;) {
+        if(poll(fds, 2, -1) < 0) {
+          if(errno == EINTR) continue;
+          perror("zsdatab-server: poll");
+          break;
+        }
+        if(fds[1].revents) break;
+        if(!(fds[0].revents & POLLIN)) continue;
+
+        const int cfd = accept4(_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if(cfd < 0) continue;
+        if(!same_user(cfd)) {
+          close(cfd);
+          continue;
+        }
+        {
+          lock_guard<mutex> lock(_mtx);
+          _clients.insert(cfd);
+        }
+        thread(&server::handle, this, cfd).detach();
+      }
+    }
+
+    // shutdown - wait for the running requests, write back and unlock all tables
+    void shutdown() {
+      unique_lock<mutex> lock(_mtx);
+      _stop = true;
+      for(const auto i : _clients)
+        ::shutdown(i, SHUT_RD);
+      _idle.wait(lock, [this] { return _clients.empty(); });
+
+      for(auto &i : _tables) {
+        lock_guard<mutex> lock2(i.second->mtx);
+        i.second->tab.reset();
+      }
+      _tables.clear();
+    }
+  };
+}
+
+int main(int argc, char *argv[]) {
+  string path = socket_path();
+  if(argc == 3 && string(argv[1]) == "-s") {
+    path = argv[2];
+  } else if(argc != 1) {
+    cerr << "USAGE: zsdatab-server [-s SOCKET]\n"
+            "\n"
+            "Keeps the used tables loaded and locked and runs the commands of zsdatab-entry\n"
+            "(client mode) on them; the tables are written back after every request\n"
+            "and unlocked when the server exits (SIGINT, SIGTERM)\n"
+            "\n"
+            "Options:\n"
+            "  -s SOCKET   listen on SOCKET instead of $ZSDATAB_SOCKET, $XDG_RUNTIME_DIR/zsdatab.sock\n"
+            "              or /tmp/zsdatab-UID.sock\n"
+            "\n"
+            "zsdatab v0.3.1 by zseri <zseri.devel@ytrizja.de>\n"
+            "released under LGPL-2.1-or-later\n";
+    return 1;
+  }
+
+  sockaddr_un addr = {};
+  if(path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    cerr << "zsdatab-server: ERROR: invalid socket path '" << path << "'\n";
+    return 1;
+  }
+  addr.sun_family = AF_UNIX;
+  path.copy(addr.sun_path, path.size());
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd < 0) {
+    perror("zsdatab-server: socket");
+    return 1;
+  }
+
+  // only the owner may connect
+  const mode_t old_umask = umask(077);
+  int bret = bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr));
+  if(bret && errno == EADDRINUSE) {
+    // remove a stale socket, but don't steal it from a running server
+    const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const bool alive = !connect(probe, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr));
+    close(probe);
+    if(alive) {
+      cerr << "zsdatab-server: ERROR: " << path << ": a server is already running\n";
+      return 1;
+    }
+    unlink(path.c_str());
+    bret = bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr));
+  }
+  umask(old_umask);
+  if(bret || listen(fd, 64)) {
+    cerr << "zsdatab-server: ERROR: " << path << ": " << strerror(errno) << '\n';
+    return 1;
+  }
+
+  if(pipe2(sig_pipe, O_CLOEXEC)) {
+    perror("zsdatab-server: pipe");
+    return 1;
+  }
+  struct sigaction sa = {};
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  cerr << "zsdatab-server: listening on " << path << '\n';
+  {
+    server srv(fd);
+    srv.run();
+    close(fd);
+    unlink(path.c_str());
+    srv.shutdown();
+  }
+  return 0;
+}
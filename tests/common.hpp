@@ -0,0 +1,51 @@
+/**********************************************
+ *  header: zsdatab tests
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+#pragma once
+#include "zsdatable.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+#include <string>
+#include <utility>
+
+// check - stop the test with the failed condition
+#define check(cond) ((cond) ? void(0) : zsdatab_test::fail(#cond, __FILE__, __LINE__))
+
+namespace zsdatab_test {
+  [[noreturn]] inline void fail(const char *cond, const char *file, const int line) {
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, cond);
+    exit(1);
+  }
+
+  inline auto par_runs(const std::string &op) -> size_t {
+    for(const auto &i : zsdatab::get_parallel_stats())
+      if(i.op == op) return i.par_runs;
+    fail(op.c_str(), __FILE__, __LINE__);
+  }
+
+  /* seq_and_par - the results of fn with one thread and with four threads
+   * (op runs in parallel from 2 elements on, checked)
+   */
+  template<class Fn>
+  auto seq_and_par(const std::string &op, const Fn &fn) -> std::pair<decltype(fn()), decltype(fn())> {
+    zsdatab::set_parallel_threshold(op, 2);
+    zsdatab::set_thread_count(1);
+    auto seq = fn();
+    zsdatab::set_thread_count(4);
+    const size_t runs = par_runs(op);
+    auto par = fn();
+    check(par_runs(op) > runs);
+    zsdatab::set_parallel_threshold(op, 0);
+    return {std::move(seq), std::move(par)};
+  }
+
+  // random_word - 0 to max_len chars of alphabet
+  inline auto random_word(std::mt19937 &rng, const std::string &alphabet, const size_t max_len) -> std::string {
+    std::string ret(rng() % (max_len + 1), '\0');
+    for(auto &c : ret) c = alphabet[rng() % alphabet.size()];
+    return ret;
+  }
+}
@@ -0,0 +1,99 @@
+/**********************************************
+ *    test: distinct
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <set>
+
+using namespace std;
+using namespace zsdatab_test;
+
+// first occurrence of every element, in input order
+template<class T>
+static auto first_seen(const vector<T> &in) -> vector<T> {
+  set<T> seen;
+  vector<T> ret;
+  for(const auto &i : in)
+    if(seen.insert(i).second) ret.push_back(i);
+  return ret;
+}
+
+int main() {
+  mt19937 rng(26);
+
+  const zsdatab::metadata meta(':', {"a", "b"});
+  zsdatab::buffer_t rows;
+  for(size_t i = 0; i < 30000; ++i)
+    rows.push_back({random_word(rng, "xy", 4), random_word(rng, "xyz", 2)});
+  zsdatab::table tab(meta, rows);
+
+  // the first occurrence of every row, on all rows and on a sorted selection
+  for(const bool sorted : {false, true}) {
+    auto in = rows;
+    if(sorted) sort(in.begin(), in.end());
+    const auto res = seq_and_par("distinct", [&] {
+      zsdatab::context c(tab);
+      if(sorted) c.sort();
+      return c.distinct().data();
+    });
+    const auto ref = first_seen(in);
+    check(res.first == ref);
+    check(res.second == ref);
+  }
+
+  // distinct after a sort == uniq
+  {
+    zsdatab::context c(tab);
+    c.sort().distinct();
+    check(c.data() == zsdatab::context(tab).uniq().data());
+  }
+
+  // the same row twice in the storage (context appended to itself)
+  {
+    const auto res = seq_and_par("distinct", [&] {
+      zsdatab::context c(tab);
+      c.filter("a", "xyxy", true);
+      c += zsdatab::context(c);
+      return c.distinct().data();
+    });
+    zsdatab::buffer_t in;
+    for(const auto &r : rows)
+      if(r[0] == "xyxy") in.push_back(r);
+    const auto ref = first_seen(in);
+    check(res.first == ref);
+    check(res.second == ref);
+  }
+
+  // column values: get(_uniq = true) and count_distinct
+  {
+    vector<string> col;
+    for(const auto &r : rows) col.push_back(r[1]);
+    const auto ref = first_seen(col);
+    const auto res = seq_and_par("distinct", [&] {
+      return zsdatab::context(tab).get_column_data("b", true);
+    });
+    check(res.first == ref);
+    check(res.second == ref);
+    const auto cnt = seq_and_par("distinct", [&] {
+      return zsdatab::context(tab).count_distinct("b");
+    });
+    check(cnt.first == ref.size());
+    check(cnt.second == ref.size());
+  }
+
+  // less than two rows
+  {
+    zsdatab::context c(tab);
+    c.limit(1).distinct();
+    check(c.data() == zsdatab::buffer_t{rows.front()});
+    c.clear().distinct();
+    check(c.data().empty());
+  }
+
+  puts("ok");
+  return 0;
+}
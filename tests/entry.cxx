@@ -0,0 +1,88 @@
+/**********************************************
+ *    test: zsdatab-entry commands
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "common.hpp"
+#include "entry_common.hpp"
+
+#include <unistd.h>
+
+#include <sstream>
+
+using namespace std;
+using namespace zsdatab_test;
+
+struct result {
+  int code;
+  string out, err;
+};
+
+// read_back - read_message of the raw data (the whole data is written before)
+static bool read_back(const string &data, vector<string> &msg, const size_t max_strings, const size_t max_size) {
+  int fds[2];
+  check(!pipe(fds));
+  check(write(fds[1], data.data(), data.size()) == ssize_t(data.size()));
+  close(fds[1]);
+  const bool ret = zsdatab_entry::read_message(fds[0], msg, max_strings, max_size);
+  close(fds[0]);
+  return ret;
+}
+
+// run - run words as a script line against a table with the rows 0..9
+static auto run(const deque<string> &words) -> result {
+  zsdatab::buffer_t rows;
+  for(size_t i = 0; i < 10; ++i)
+    rows.push_back({"x", to_string(i)});
+  zsdatab::table tab(zsdatab::metadata(':', {"a", "b"}), rows);
+
+  ostringstream out, err;
+  zsdatab_entry::session s(tab, true, out, err);
+  auto commands = words;
+  const int code = zsdatab_entry::run_commands(s, commands);
+  return {code, out.str(), err.str()};
+}
+
+int main() {
+  // counts
+  {
+    const auto res = run({"limit", "3", "count", "top", "b", "desc", "1", "get", "b"});
+    check(res.code == -1);
+    check(res.out == "3\n2\n");
+    check(run({"select", "a", "x", "limit", "18446744073709551615", "count"}).out == "10\n");
+  }
+
+  // counts out of range are invalid args, not unknown fieldnames
+  for(const auto &words : vector<deque<string>>{
+        {"limit", "18446744073709551616"},
+        {"limit", "99999999999999999999999999999"},
+        {"limit", "-1"},
+        {"limit", "1e3"},
+        {"top", "b", "asc", "99999999999999999999999999999"},
+        {"select", "a", "x", "limit", "99999999999999999999999999999"},
+        {"xsel", "whole", "a", "x", "limit", "99999999999999999999999999999"},
+        {"where", "b < 3", "limit", "99999999999999999999999999999"},
+      }) {
+    const auto res = run(words);
+    check(res.code == 1);
+    check(res.err == "zsdatab-entry: ERROR: command limit: invalid args\n" || res.err == "zsdatab-entry: ERROR: command top: invalid args\n");
+  }
+
+  // messages
+  {
+    vector<string> msg;
+    check(read_back("2\n3\nabc0\n", msg, 2, 3));
+    check((msg == vector<string>{"abc", ""}));
+    check(read_back("0\n", msg, 0, 0));
+    check(msg.empty());
+
+    // more strings or bytes than allowed, also digits greater than the limit
+    for(const char *data : {"3\n", "9\n", "10\n", "1\n4\nabcd", "1\n9\nabcdefghi", "2\n3\nabc1\nd",
+                            "99999999999999999999\n", "1\n99999999999999999999\n", "\n", "1x\n"})
+      check(!read_back(data, msg, 2, 3));
+  }
+
+  puts("ok");
+  return 0;
+}
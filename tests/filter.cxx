@@ -0,0 +1,88 @@
+/**********************************************
+ *    test: parallel_filter
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "common.hpp"
+#include "pool.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+
+using namespace std;
+using namespace zsdatab_test;
+
+int main() {
+  mt19937 rng(36);
+
+  // parallel_filter itself: chunks without kept elements, with only kept ones, ...
+  {
+    const size_t n = 100000;
+    const vector<function<bool (size_t)>> keeps = {
+      [](size_t) { return false; },
+      [](size_t) { return true; },
+      [](const size_t i) { return i % 2 == 0; },
+      [n](const size_t i) { return i < n / 3 || i > n - 10; },
+      [n](const size_t i) { return i == n - 1; },
+    };
+    for(const auto &keep : keeps) {
+      const auto res = seq_and_par("filter", [&] {
+        vector<size_t> buf(n);
+        iota(buf.begin(), buf.end(), 0);
+        zsdatab::intern::parallel_filter(zsdatab::intern::par_op::filter, buf, [&keep](const size_t i) { return keep(i); });
+        return buf;
+      });
+      vector<size_t> ref;
+      for(size_t i = 0; i < n; ++i)
+        if(keep(i)) ref.push_back(i);
+      check(res.first == ref);
+      check(res.second == ref);
+    }
+  }
+
+  const zsdatab::metadata meta(':', {"a", "b"});
+  zsdatab::buffer_t rows;
+  for(size_t i = 0; i < 20000; ++i)
+    rows.push_back({random_word(rng, "xyz", 3), to_string(i)});
+  zsdatab::table tab(meta, rows);
+
+  const auto ref_filter = [](const zsdatab::buffer_t &in, const string &v, const bool whole, const bool neg) {
+    zsdatab::buffer_t ret;
+    for(const auto &r : in)
+      if(((whole ? (r[0] == v) : (r[0].find(v) != string::npos))) != neg)
+        ret.push_back(r);
+    return ret;
+  };
+
+  // whole/part, negated, on all rows and on a sorted selection
+  for(const bool sorted : {false, true}) {
+    auto in = rows;
+    if(sorted) sort(in.begin(), in.end());
+    for(const bool whole : {true, false})
+      for(const bool neg : {false, true}) {
+        const auto res = seq_and_par("filter", [&] {
+          zsdatab::context c(tab);
+          if(sorted) c.sort();
+          return c.filter("a", "xy", whole, neg).data();
+        });
+        const auto ref = ref_filter(in, "xy", whole, neg);
+        check(res.first == ref);
+        check(res.second == ref);
+      }
+  }
+
+  // negate: the rows of the table which aren't selected, in table order
+  {
+    const auto res = seq_and_par("negate", [&] {
+      return zsdatab::context(tab).filter("a", "z", false).negate().data();
+    });
+    const auto ref = ref_filter(rows, "z", false, true);
+    check(res.first == ref);
+    check(res.second == ref);
+  }
+
+  puts("ok");
+  return 0;
+}
@@ -0,0 +1,94 @@
+/**********************************************
+ *    test: fixcol mutations
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "common.hpp"
+
+#include <functional>
+
+using namespace std;
+using namespace zsdatab_test;
+
+// replace_all - reference for replace_part (non-overlapping, left to right)
+static string replace_all(string f, const string &from, const string &to) {
+  for(size_t p = 0; (p = f.find(from, p)) != string::npos; p += to.size())
+    f.replace(p, from.size(), to);
+  return f;
+}
+
+// kernel - one column mutation, as context call and as reference on a field
+struct kernel {
+  string name;
+  function<void (zsdatab::context &)> ctx;
+  function<void (string &)> ref;
+};
+
+int main() {
+  mt19937 rng(40);
+
+  const zsdatab::metadata meta(':', {"a", "b"});
+  zsdatab::buffer_t rows;
+  for(size_t i = 0; i < 20000; ++i)
+    rows.push_back({random_word(rng, "ab", 8), to_string(i)});
+  zsdatab::table tab(meta, rows);
+
+  const vector<kernel> kernels = {
+    {"set",            [](auto &c) { c.set_field("a", "ab"); },           [](string &f) { f = "ab"; }},
+    {"set empty",      [](auto &c) { c.set_field("a", ""); },             [](string &f) { f.clear(); }},
+    {"append",         [](auto &c) { c.append_part("a", "+"); },          [](string &f) { f += '+'; }},
+    {"remove",         [](auto &c) { c.remove_part("a", "ab"); },         [](string &f) {
+      const size_t p = f.find("ab");
+      if(p != string::npos) f.erase(p, 2); }},
+    {"replace shrink", [](auto &c) { c.replace_part("a", "aa", "b"); },   [](string &f) { f = replace_all(f, "aa", "b"); }},
+    {"replace grow",   [](auto &c) { c.replace_part("a", "a", "aba"); },  [](string &f) { f = replace_all(f, "a", "aba"); }},
+    {"replace same",   [](auto &c) { c.replace_part("a", "ab", "ba"); },  [](string &f) { f = replace_all(f, "ab", "ba"); }},
+    {"proxy replace",  [](auto &c) { c.column("a").replace("ba", ""); },  [](string &f) { f = replace_all(f, "ba", ""); }},
+  };
+
+  for(const auto &k : kernels) {
+    // on all rows and on a selection with every row stored twice (changed once per occurrence);
+    // the table and other contexts keep the old rows
+    for(const bool twice : {false, true}) {
+      const auto res = seq_and_par("fixcol", [&] {
+        zsdatab::context c(tab), other(tab);
+        if(twice) {
+          c.filter("a", "b", false);
+          c += zsdatab::context(c);
+        }
+        k.ctx(c);
+        return vector<zsdatab::buffer_t>{c.data(), other.data()};
+      });
+
+      zsdatab::buffer_t ref;
+      for(const auto &r : rows)
+        if(!twice || r[0].find('b') != string::npos) ref.push_back(r);
+      if(twice) {
+        const auto once = ref;
+        ref.insert(ref.end(), once.begin(), once.end());
+      }
+      for(auto &r : ref) k.ref(r[0]);
+
+      for(const auto *i : {&res.first, &res.second}) {
+        if((*i)[0] != ref) fail(k.name.c_str(), __FILE__, __LINE__);
+        check((*i)[1] == rows);
+      }
+    }
+  }
+
+  // mutations which don't change anything
+  for(const auto &noop : vector<function<void (zsdatab::context &)>>{
+        [](auto &c) { c.append_part("a", ""); },
+        [](auto &c) { c.remove_part("a", ""); },
+        [](auto &c) { c.replace_part("a", "", "x"); },
+        [](auto &c) { c.replace_part("a", "b", "b"); },
+      }) {
+    zsdatab::context c(tab);
+    noop(c);
+    check(c.data() == rows);
+  }
+
+  puts("ok");
+  return 0;
+}
@@ -0,0 +1,95 @@
+/**********************************************
+ *    test: group_by
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+using namespace std;
+using namespace zsdatab_test;
+
+int main() {
+  mt19937 rng(30);
+
+  // numbers (exact in binary, so the sums don't depend on the order) and values which count as 0
+  const pair<const char *, double> numbers[] = {
+    {"1", 1}, {"-2", -2}, {"+3", 3}, {"0.25", 0.25}, {".5", 0.5}, {"2.", 2}, {"1e2", 100}, {"-1.5E1", -15}, {"007", 7},
+  };
+  const char *const not_numbers[] = {
+    "", "n/a", "12abc", " 1", "1 ", "nan", "inf", "-inf", "0x10", "1e", "+", ".", "-.e1", "1,5", "1e999",
+  };
+
+  const zsdatab::metadata meta(':', {"g", "v"});
+  zsdatab::buffer_t rows;
+  vector<double> vals;
+  for(size_t i = 0; i < 30000; ++i) {
+    const string g = random_word(rng, "xyz", 2);
+    if(rng() % 3) {
+      const auto &n = numbers[rng() % size(numbers)];
+      rows.push_back({g, n.first});
+      vals.push_back(n.second);
+    } else {
+      rows.push_back({g, not_numbers[rng() % size(not_numbers)]});
+      vals.push_back(0);
+    }
+  }
+  zsdatab::table tab(meta, rows);
+
+  // reference: groups in order of their first occurrence
+  struct group {
+    size_t count = 0;
+    string min, max;
+    double sum = 0;
+    set<string> distinct;
+  };
+  vector<string> order;
+  map<string, group> groups;
+  for(size_t i = 0; i < rows.size(); ++i) {
+    const auto &r = rows[i];
+    const auto it = groups.find(r[0]);
+    auto &g = (it == groups.end()) ? groups[r[0]] : it->second;
+    if(!g.count) {
+      order.push_back(r[0]);
+      g.min = g.max = r[1];
+    }
+    ++g.count;
+    g.min = min(g.min, r[1]);
+    g.max = max(g.max, r[1]);
+    g.sum += vals[i];
+    g.distinct.insert(r[1]);
+  }
+
+  const auto res = seq_and_par("group_by", [&] {
+    auto out = zsdatab::context(tab).group_by({"g"}).agg({
+      {zsdatab::agg::count, {}},
+      {zsdatab::agg::min, "v"},
+      {zsdatab::agg::max, "v"},
+      {zsdatab::agg::sum, "v"},
+      {zsdatab::agg::count_distinct, "v"},
+    });
+    return zsdatab::context(out).data();
+  });
+
+  for(const zsdatab::buffer_t *out : {&res.first, &res.second}) {
+    check(out->size() == order.size());
+    for(size_t i = 0; i < order.size(); ++i) {
+      const auto &r = (*out)[i];
+      const auto &g = groups[order[i]];
+      check(r.size() == 6);
+      check(r[0] == order[i]);
+      check(r[1] == to_string(g.count));
+      check(r[2] == g.min);
+      check(r[3] == g.max);
+      check(strtod(r[4].c_str(), nullptr) == g.sum);
+      check(r[5] == to_string(g.distinct.size()));
+    }
+  }
+
+  puts("ok");
+  return 0;
+}
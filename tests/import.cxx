@@ -0,0 +1,128 @@
+/**********************************************
+ *    test: parse_rows
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "common.hpp"
+
+#include <algorithm>
+
+using namespace std;
+using namespace zsdatab_test;
+
+static auto quoted(const string &f) -> string {
+  string ret = "\"";
+  for(const char c : f) {
+    if(c == '"') ret += '"';
+    ret += c;
+  }
+  return ret + '"';
+}
+
+// csv_field - field as CSV, quoted if needed (or randomly)
+static auto csv_field(mt19937 &rng, const string &f) -> string {
+  if(f.find_first_of(",\"\r\n") == string::npos && (rng() % 4)) return f;
+  return quoted(f);
+}
+
+// import - the rows of data imported as CSV, with one and with four threads
+static auto import(const zsdatab::metadata &meta, const string &data) -> pair<zsdatab::buffer_t, zsdatab::buffer_t> {
+  zsdatab::import_options opts;
+  opts.format = zsdatab::import_format::csv;
+  return seq_and_par("import", [&]() -> zsdatab::buffer_t {
+    zsdatab::table t(meta);
+    t.import_rows(data, opts);
+    return t.data();
+  });
+}
+
+// import_error - the message of the import error of data, with one and with four threads
+static auto import_error(const zsdatab::metadata &meta, const string &data) -> pair<string, string> {
+  zsdatab::import_options opts;
+  opts.format = zsdatab::import_format::csv;
+  return seq_and_par("import", [&] {
+    zsdatab::table t(meta);
+    try {
+      t.import_rows(data, opts);
+    } catch(const zsdatab::import_error &e) {
+      return string(e.what());
+    }
+    return string();
+  });
+}
+
+int main() {
+  mt19937 rng(43);
+  const zsdatab::metadata meta(':', {"a", "b", "c"});
+
+  for(size_t it = 0; it < 20; ++it) {
+    string data;
+    zsdatab::buffer_t ref;
+    for(size_t r = rng() % 5000; r; --r) {
+      zsdatab::row_t row;
+      for(size_t f = 0; f < 3; ++f) {
+        if(f) data += ',';
+        switch(rng() % 4) {
+          case 0:
+            // quotes, separators and line breaks inside of a quoted field
+            row.push_back(random_word(rng, "a,\"\r\n", 8));
+            data += csv_field(rng, row.back());
+            break;
+          case 1:
+            // a quote only opens a field at its start
+            row.push_back("x" + random_word(rng, "a\"", 4));
+            data += row.back();
+            break;
+          case 2:
+            // text after the closing quote is kept
+            row.push_back(random_word(rng, "a\n\"", 4));
+            data += quoted(row.back()) + "b\"";
+            row.back() += "b\"";
+            break;
+          default:
+            row.push_back(random_word(rng, "ab", 4));
+            data += row.back();
+        }
+      }
+      ref.push_back(move(row));
+      data += (rng() % 2) ? "\n" : "\r\n";
+      // empty lines are skipped
+      if(!(rng() % 50)) data += "\n";
+    }
+
+    const auto res = import(meta, data);
+    check(res.first == ref);
+    check(res.second == ref);
+  }
+
+  // quoted fields with many line breaks, most chunk bounds fall into one of them
+  {
+    string data;
+    zsdatab::buffer_t ref;
+    for(size_t i = 0; i < 2000; ++i) {
+      string f;
+      for(size_t l = rng() % 100; l; --l) f += random_word(rng, "ab,", 5) + ((rng() % 2) ? "\n" : "\r\n");
+      ref.push_back({to_string(i), f, ""});
+      data += to_string(i) + "," + quoted(f) + ",\n";
+    }
+    const auto res = import(meta, data);
+    check(res.first == ref);
+    check(res.second == ref);
+  }
+
+  // the error names the line of the invalid record, also if it is in a later chunk
+  {
+    string data;
+    for(size_t i = 0; i < 30000; ++i)
+      data += to_string(i) + ",\"x\ny\",z\n";
+    const string line = to_string(count(data.begin(), data.end(), '\n') + 1);
+    data += "1,2\n3,4,5\n";
+    const auto res = import_error(meta, data);
+    check(res.first == res.second);
+    check(res.first.find("line " + line + ":") != string::npos);
+  }
+
+  puts("ok");
+  return 0;
+}
@@ -0,0 +1,94 @@
+/**********************************************
+ *    test: predicate
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "common.hpp"
+
+#include <cmath>
+#include <functional>
+#include <regex>
+#include <stdexcept>
+
+using namespace std;
+using namespace zsdatab_test;
+
+// num - the numeric value of a field (fields which aren't plain decimal numbers never match)
+static bool num(const string &f, double &ret) {
+  static const regex plain("[+-]?([0-9]+\\.?[0-9]*|\\.[0-9]+)([eE][+-]?[0-9]+)?");
+  if(!regex_match(f, plain)) return false;
+  ret = strtod(f.c_str(), nullptr);
+  return !isinf(ret);
+}
+
+static bool throws(const string &expr) {
+  try {
+    zsdatab::predicate::parse(expr);
+  } catch(const invalid_argument &) {
+    return true;
+  }
+  return false;
+}
+
+int main() {
+  mt19937 rng(34);
+  const zsdatab::metadata meta(':', {"a", "b", "c"});
+
+  // b: integers, other spellings of numbers and values which aren't (plain) numbers
+  const char *const other_values[] = {
+    "n/a", "", "5x", "1e", "-", "1.2.3", " 1", "1 ", "0x10", "nan", "inf", "-inf", "1e999", "+.5", "-7.", "1E+1",
+  };
+  zsdatab::buffer_t rows;
+  for(size_t i = 0; i < 20000; ++i)
+    rows.push_back({
+      random_word(rng, "xyz", 3),
+      (rng() % 8) ? to_string(int(rng() % 101) - 50) : other_values[rng() % size(other_values)],
+      random_word(rng, "xy q\"\\", 6)
+    });
+  zsdatab::table tab(meta, rows);
+
+  const auto lt = [](const string &f, const double v) { double d; return num(f, d) && d < v; };
+  const auto ge = [](const string &f, const double v) { double d; return num(f, d) && d >= v; };
+  const regex re("^[xy]+$");
+
+  const vector<pair<string, function<bool (const zsdatab::row_t &)>>> cases = {
+    {"a = xy",                      [](const zsdatab::row_t &r) { return r[0] == "xy"; }},
+    {"a != xy",                     [](const zsdatab::row_t &r) { return r[0] != "xy"; }},
+    {"c ~ \"q\\\"\"",               [](const zsdatab::row_t &r) { return r[2].find("q\"") != string::npos; }},
+    {"c ~ '\\\\'",                  [](const zsdatab::row_t &r) { return r[2].find('\\') != string::npos; }},
+    {"a ^= x and b < 0",            [&](const zsdatab::row_t &r) { return !r[0].compare(0, 1, "x") && lt(r[1], 0); }},
+    {"not (b >= 10 or a = '')",     [&](const zsdatab::row_t &r) { return !(ge(r[1], 10) || r[0].empty()); }},
+    {"b == 5 || b <> 5",            [&](const zsdatab::row_t &r) { double d; return num(r[1], d); }},
+    {"b <= -2.5e1",                 [&](const zsdatab::row_t &r) { return lt(r[1], -24); }},
+    {"b >= +.5",                    [&](const zsdatab::row_t &r) { return ge(r[1], 0.5); }},
+    {"c =~ \"^[xy]+$\"",            [&](const zsdatab::row_t &r) { return regex_search(r[2], re); }},
+    {"a = x OR a = y AND NOT b > 3", [&](const zsdatab::row_t &r) { return r[0] == "x" || (r[0] == "y" && !ge(r[1], 4)); }},
+    {"!(a = x) && (c ~ q || b = n/a)", [](const zsdatab::row_t &r) {
+      return r[0] != "x" && (r[2].find('q') != string::npos || r[1] == "n/a"); }},
+  };
+
+  for(const auto &i : cases) {
+    const auto pred = zsdatab::predicate::parse(i.first);
+    zsdatab::buffer_t ref;
+    for(const auto &r : rows)
+      if(i.second(r)) ref.push_back(r);
+    const auto res = seq_and_par("filter", [&] { return zsdatab::context(tab).filter(pred).data(); });
+    if(res.first != ref || res.second != ref) fail(i.first.c_str(), __FILE__, __LINE__);
+
+    // to_string can be parsed again
+    const auto again = zsdatab::predicate::parse(pred.to_string());
+    if(zsdatab::context(tab).filter(again).data() != ref) fail(pred.to_string().c_str(), __FILE__, __LINE__);
+  }
+
+  for(const char *i : {"", "a =", "a = \"x", "(a = x", "a = x)", "a = x b", "a =~ \"(\"", "a @ 1", "and a = x"})
+    if(!throws(i)) fail(i, __FILE__, __LINE__);
+
+  // malformed numbers
+  for(const char *i : {"b < x", "b < ''", "b < 1e", "b < 5x", "b < -", "b < 1.2.3", "b < '1 2'", "b < ' 1'", "b < '1 '",
+                        "b < 0x10", "b < nan", "b < inf", "b < -inf", "b < 1e999", "b < ."})
+    if(!throws(i)) fail(i, __FILE__, __LINE__);
+
+  puts("ok");
+  return 0;
+}
@@ -0,0 +1,112 @@
+/**********************************************
+ *    test: sort
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "common.hpp"
+
+#include <algorithm>
+
+using namespace std;
+using namespace zsdatab_test;
+
+// keys - the given columns of every row
+static auto keys(const zsdatab::buffer_t &rows, const vector<size_t> &cols) -> zsdatab::buffer_t {
+  zsdatab::buffer_t ret;
+  ret.reserve(rows.size());
+  for(const auto &r : rows) {
+    ret.emplace_back();
+    for(const auto c : cols) ret.back().push_back(r[c]);
+  }
+  return ret;
+}
+
+/* sorted - rows sorted by the context (with stable_sort if stable),
+ * checks that the parallel and the sequential sort agree
+ */
+static auto sorted(zsdatab::table &tab, const zsdatab::sort_spec &spec, const bool stable) -> zsdatab::buffer_t {
+  const auto res = zsdatab_test::seq_and_par("sort", [&]() -> zsdatab::buffer_t {
+    zsdatab::context c(tab);
+    if(spec.empty())  c.sort();
+    else if(stable)   c.stable_sort(spec);
+    else              c.sort(spec);
+    return c.data();
+  });
+  check(res.first == res.second);
+  return res.second;
+}
+
+int main() {
+  mt19937 rng(28);
+  const zsdatab::metadata meta(':', {"a", "b", "c"});
+
+  // long common prefixes and bytes >= 0x80 need more than one radix pass
+  zsdatab::buffer_t rows;
+  const string prefixes[] = {"", "abcdefgh", "abcdefghijklmnop", "\xc3\xa4"};
+  for(size_t i = 0; i < 20000; ++i)
+    rows.push_back({
+      prefixes[rng() % 4] + random_word(rng, "ab\xc3\xa4", 12),
+      random_word(rng, "0123456789", 3),
+      to_string(i)
+    });
+  zsdatab::table tab(meta, rows);
+
+  // all columns (c makes the rows unique)
+  {
+    auto ref = rows;
+    sort(ref.begin(), ref.end());
+    check(sorted(tab, {}, false) == ref);
+  }
+
+  // mixed directions: equal keys may be in any order
+  {
+    auto ref = rows;
+    stable_sort(ref.begin(), ref.end(), [](const zsdatab::row_t &x, const zsdatab::row_t &y) {
+      return x[0] != y[0] ? x[0] > y[0] : x[1] < y[1];
+    });
+    check(keys(sorted(tab, {{"a", zsdatab::desc}, {"b", zsdatab::asc}}, false), {0, 1}) == keys(ref, {0, 1}));
+  }
+
+  // stable: equal keys keep their order
+  {
+    auto ref = rows;
+    stable_sort(ref.begin(), ref.end(), [](const zsdatab::row_t &x, const zsdatab::row_t &y) { return x[1] > y[1]; });
+    check(sorted(tab, {{"b", zsdatab::desc}}, true) == ref);
+  }
+
+  // long equal keys: equal fields, fields which only differ at the end or in their length
+  {
+    const string long_key(1000, 'k');
+    zsdatab::buffer_t lrows;
+    for(size_t i = 0; i < 1000; ++i)
+      lrows.push_back({long_key, long_key + random_word(rng, "ab", 2), to_string(rng() % 100)});
+    zsdatab::table ltab(meta, lrows);
+
+    auto ref = lrows;
+    sort(ref.begin(), ref.end());
+    check(sorted(ltab, {}, false) == ref);
+
+    stable_sort(lrows.begin(), lrows.end(), [](const zsdatab::row_t &x, const zsdatab::row_t &y) { return x[1] > y[1]; });
+    check(sorted(ltab, {{"a", zsdatab::asc}, {"b", zsdatab::desc}}, true) == lrows);
+  }
+
+  // very long equal keys: 100 KB fields, equal in all rows or differing only at the end
+  {
+    const string huge_key(100000, 'k');
+    zsdatab::buffer_t hrows;
+    for(size_t i = 0; i < 200; ++i)
+      hrows.push_back({huge_key, huge_key + random_word(rng, "ab", 3), to_string(i)});
+    zsdatab::table htab(meta, hrows);
+
+    auto ref = hrows;
+    sort(ref.begin(), ref.end());
+    check(sorted(htab, {}, false) == ref);
+
+    stable_sort(hrows.begin(), hrows.end(), [](const zsdatab::row_t &x, const zsdatab::row_t &y) { return x[1] > y[1]; });
+    check(sorted(htab, {{"a", zsdatab::desc}, {"b", zsdatab::desc}}, true) == hrows);
+  }
+
+  puts("ok");
+  return 0;
+}
@@ -0,0 +1,113 @@
+/**********************************************
+ *    test: transaction plans
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "common.hpp"
+
+#include <functional>
+
+using namespace std;
+using namespace zsdatab_test;
+
+/* step - one action, as transaction action and as direct context call
+ * (the context calls are the unoptimized reference)
+ */
+struct step {
+  string name;
+  function<void (zsdatab::transaction &)> ta;
+  function<void (zsdatab::context &)> ctx;
+};
+
+int main() {
+  mt19937 rng(31);
+
+  // few distinct values: filters, distinct and uniq have something to do;
+  // the sort keys cover all columns, so equal keys mean equal rows
+  const zsdatab::metadata meta(':', {"a", "b"});
+  zsdatab::buffer_t rows;
+  for(size_t i = 0; i < 3000; ++i)
+    rows.push_back({random_word(rng, "xy", 3), random_word(rng, "xyz", 2)});
+  zsdatab::table tab(meta, rows);
+
+  const zsdatab::sort_spec spec = {{"a", zsdatab::desc}, {"b", zsdatab::asc}};
+  const auto pred = zsdatab::predicate::parse("b ~ x or a = y");
+  const vector<step> steps = {
+    {"filter whole", [](auto &t) { t.filter("a", "xy"); },        [](auto &c) { c.filter("a", "xy"); }},
+    {"filter part",  [](auto &t) { t.filter("b", "y", false); },  [](auto &c) { c.filter("b", "y", false); }},
+    {"filter pred",  [&](auto &t) { t.filter(pred); },            [&](auto &c) { c.filter(pred); }},
+    {"sort",         [](auto &t) { t.sort(); },                   [](auto &c) { c.sort(); }},
+    {"sort spec",    [&](auto &t) { t.sort(spec); },              [&](auto &c) { c.sort(spec); }},
+    {"stable_sort",  [](auto &t) { t.stable_sort({{"b", zsdatab::desc}}); },
+                     [](auto &c) { c.stable_sort({{"b", zsdatab::desc}}); }},
+    {"uniq",         [](auto &t) { t.uniq(); },                   [](auto &c) { c.uniq(); }},
+    {"distinct",     [](auto &t) { t.distinct(); },               [](auto &c) { c.distinct(); }},
+    {"negate",       [](auto &t) { t.negate(); },                 [](auto &c) { c.negate(); }},
+    {"limit 500",    [](auto &t) { t.limit(500); },               [](auto &c) { c.limit(500); }},
+    {"limit 20",     [](auto &t) { t.limit(20); },                [](auto &c) { c.limit(20); }},
+    {"top_k 50",     [&](auto &t) { t.top_k(spec, 50); },         [&](auto &c) { c.top_k(spec, 50); }},
+  };
+  const auto find_step = [&steps](const string &name) -> const step& {
+    for(const auto &i : steps)
+      if(i.name == name) return i;
+    fail(name.c_str(), __FILE__, __LINE__);
+  };
+
+  for(const char *op : {"filter", "negate", "uniq", "distinct", "sort"})
+    zsdatab::set_parallel_threshold(op, 2);
+
+  // run - the transaction result (with 1 and 4 threads) must match the direct context calls
+  const auto run = [&](const vector<const step *> &seq) {
+    zsdatab::set_thread_count(1);
+    zsdatab::context ref(tab);
+    for(const auto i : seq) i->ctx(ref);
+
+    zsdatab::transaction ta(meta);
+    for(const auto i : seq) i->ta(ta);
+    for(const size_t threads : {1, 4}) {
+      zsdatab::set_thread_count(threads);
+      zsdatab::context c(tab);
+      ta.apply(c);
+      if(c.data() != ref.data()) {
+        string names;
+        for(const auto i : seq) names += ' ' + i->name;
+        fail(names.c_str(), __FILE__, __LINE__);
+      }
+    }
+  };
+
+  // the rewrites of the plan: filter fusion and reordering, limit -> filter with limit,
+  // sort + limit -> top_k, distinct after sort -> uniq
+  for(const auto &seq : vector<vector<string>>{
+        {"filter whole", "filter part", "filter pred"},
+        {"filter pred", "filter pred", "filter part"},
+        {"sort", "filter part", "filter whole"},
+        {"sort spec", "distinct", "filter part", "filter pred"},
+        {"stable_sort", "filter pred", "limit 20"},
+        {"filter part", "limit 20"},
+        {"filter pred", "limit 500", "filter whole"},
+        {"filter part", "limit 500", "limit 20"},
+        {"sort", "limit 20"},
+        {"sort spec", "limit 20"},
+        {"sort spec", "limit 20", "limit 500"},
+        {"top_k 50", "limit 20"},
+        {"sort", "distinct"},
+        {"sort", "distinct", "limit 20"},
+        {"uniq", "filter part", "negate"},
+      }) {
+    vector<const step *> s;
+    for(const auto &i : seq) s.push_back(&find_step(i));
+    run(s);
+  }
+
+  // random action lists
+  for(size_t n = 0; n < 300; ++n) {
+    vector<const step *> s(1 + rng() % 6);
+    for(auto &i : s) i = &steps[rng() % steps.size()];
+    run(s);
+  }
+
+  puts("ok");
+  return 0;
+}
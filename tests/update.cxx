@@ -0,0 +1,190 @@
+/**********************************************
+ *    test: update, update_where
+ * package: zsdatab
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ **********************************************/
+
+#include "common.hpp"
+
+#include <algorithm>
+
+using namespace std;
+using namespace zsdatab_test;
+
+static const zsdatab::metadata meta(':', {"id", "a", "b"});
+
+// mutate - reference implementation of the mutations
+static void mutate(zsdatab::row_t &r, const zsdatab::mutation_spec &muts) {
+  for(const auto &m : muts) {
+    auto &f = r[meta.get_field_nr(m.field)];
+    switch(m.op) {
+      case zsdatab::mut_op::set:
+        f = m.value;
+        break;
+      case zsdatab::mut_op::append:
+        f += m.value;
+        break;
+      case zsdatab::mut_op::remove_part:
+        {
+          const size_t p = f.find(m.value);
+          if(p != string::npos) f.erase(p, m.value.size());
+        }
+        break;
+      case zsdatab::mut_op::replace:
+        for(size_t p = 0; (p = f.find(m.value, p)) != string::npos; p += m.to.size())
+          f.replace(p, m.value.size(), m.to);
+        break;
+    }
+  }
+}
+
+int main() {
+  mt19937 rng(39);
+
+  // the ids make the rows unique (negate compares rows by value)
+  zsdatab::buffer_t rows;
+  for(size_t i = 0; i < 20000; ++i)
+    rows.push_back({to_string(i), random_word(rng, "xyz", 4), random_word(rng, "xy", 3)});
+
+  const auto pred = zsdatab::predicate::parse("a ~ xy or b = x");
+  const zsdatab::mutation_spec muts = {
+    {zsdatab::mut_op::replace, "a", "x", "yx"},
+    {zsdatab::mut_op::append, "a", "+", {}},
+    {zsdatab::mut_op::remove_part, "b", "y", {}},
+    {zsdatab::mut_op::set, "b", "new", {}},
+  };
+  const auto matches = [](const zsdatab::row_t &r) {
+    return r[1].find("xy") != string::npos || r[2] == "x";
+  };
+  const auto by_a = [](const zsdatab::row_t &x, const zsdatab::row_t &y) {
+    return x[1] != y[1] ? x[1] < y[1] : x < y;
+  };
+  const zsdatab::sort_spec spec = {{"a", zsdatab::asc}, {"id", zsdatab::asc}};
+
+  // table::update_where: a context made before keeps the old rows
+  {
+    const auto res = seq_and_par("update", [&] {
+      zsdatab::table tab(meta, rows);
+      zsdatab::context old(tab);
+      const size_t n = tab.update_where(pred, muts);
+      return make_pair(n, vector<zsdatab::buffer_t>{zsdatab::context(tab).data(), old.data()});
+    });
+    auto ref = rows;
+    size_t n = 0;
+    for(auto &r : ref)
+      if(matches(r)) {
+        mutate(r, muts);
+        ++n;
+      }
+    for(const auto *i : {&res.first, &res.second}) {
+      check(i->first == n);
+      check(i->second[0] == ref);
+      check(i->second[1] == rows);
+    }
+  }
+
+  // context::update_where on a sorted selection: the table and other contexts are unchanged
+  {
+    const auto res = seq_and_par("update", [&] {
+      zsdatab::table tab(meta, rows);
+      zsdatab::context c(tab), other(tab);
+      c.sort(spec);
+      c.filter("b", "y", false, true);
+      c.update_where(pred, muts);
+      return vector<zsdatab::buffer_t>{c.data(), zsdatab::context(tab).data(), other.data()};
+    });
+    zsdatab::buffer_t ref;
+    for(const auto &r : rows)
+      if(r[2].find('y') == string::npos) ref.push_back(r);
+    sort(ref.begin(), ref.end(), by_a);
+    for(auto &r : ref)
+      if(matches(r)) mutate(r, muts);
+    for(const auto *i : {&res.first, &res.second}) {
+      check((*i)[0] == ref);
+      check((*i)[1] == rows);
+      check((*i)[2] == rows);
+    }
+  }
+
+  // context::update on a sorted selection of the table rows: the rows are changed in place
+  {
+    const auto res = seq_and_par("update", [&] {
+      zsdatab::table tab(meta, rows);
+      zsdatab::context c(tab), old(tab);
+      c.sort(spec);
+      c.filter(pred);
+      c.update(muts);
+      return vector<zsdatab::buffer_t>{c.data(), zsdatab::context(tab).data(), old.data()};
+    });
+    auto ref = rows;
+    for(auto &r : ref)
+      if(matches(r)) mutate(r, muts);
+    // the selection was sorted before it was changed
+    zsdatab::buffer_t old_sel;
+    for(const auto &r : rows)
+      if(matches(r)) old_sel.push_back(r);
+    sort(old_sel.begin(), old_sel.end(), by_a);
+    for(auto &r : old_sel) mutate(r, muts);
+    for(const auto *i : {&res.first, &res.second}) {
+      check((*i)[0] == old_sel);
+      check((*i)[1] == ref);
+      check((*i)[2] == rows);
+    }
+  }
+
+  // context::update on rows which aren't the table rows (fallback: negate + push):
+  // the changed rows are moved to the end of the table
+  {
+    const zsdatab::row_t extra = {"extra", "xy", "x"};
+    const auto res = seq_and_par("update", [&] {
+      zsdatab::table tab(meta, rows);
+      zsdatab::context c(tab), old(tab);
+      c.filter(pred);
+      c += extra;
+      c.update(muts);
+      return vector<zsdatab::buffer_t>{c.data(), zsdatab::context(tab).data(), old.data()};
+    });
+    zsdatab::buffer_t ref, sel;
+    for(const auto &r : rows) {
+      if(!matches(r)) {
+        ref.push_back(r);
+        continue;
+      }
+      sel.push_back(r);
+      mutate(sel.back(), muts);
+    }
+    sel.push_back(extra);
+    mutate(sel.back(), muts);
+    ref.insert(ref.end(), sel.begin(), sel.end());
+    for(const auto *i : {&res.first, &res.second}) {
+      check((*i)[0] == sel);
+      check((*i)[1] == ref);
+      check((*i)[2] == rows);
+    }
+  }
+
+  // transaction::update_where, after a filter
+  {
+    zsdatab::transaction ta(meta);
+    ta.filter("b", "y", false).update_where(pred, muts);
+    const auto res = seq_and_par("update", [&] {
+      zsdatab::table tab(meta, rows);
+      zsdatab::context c(tab);
+      ta.apply(c);
+      return vector<zsdatab::buffer_t>{c.data(), zsdatab::context(tab).data()};
+    });
+    zsdatab::buffer_t ref;
+    for(const auto &r : rows)
+      if(r[2].find('y') != string::npos) {
+        ref.push_back(r);
+        if(matches(r)) mutate(ref.back(), muts);
+      }
+    for(const auto *i : {&res.first, &res.second}) {
+      check((*i)[0] == ref);
+      check((*i)[1] == rows);
+    }
+  }
+
+  puts("ok");
+  return 0;
+}
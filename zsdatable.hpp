@@ -22,7 +22,11 @@
  *******************************************************************************/
 
 #pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <istream>
+#include <iterator>
 #include <ostream>
 #include <string>
 #include <memory>
@@ -36,6 +40,52 @@ namespace zsdatab {
   typedef std::vector<std::string> row_t;
   typedef std::vector<row_t> buffer_t;
 
+  // shared immutable rows, copied on write
+  // (row_ptr's always point to non-const row_t objects)
+  typedef std::shared_ptr<const row_t> row_ptr;
+  typedef std::vector<row_ptr> row_store;
+
+  // sort specifications, e.g. {{"col", desc}, {"other", asc}}
+  enum sort_order { asc, desc };
+
+  struct sort_key {
+    std::string field;
+    sort_order order;
+  };
+
+  typedef std::vector<sort_key> sort_spec;
+
+  // field mutations, e.g. {{mut_op::set, "status", "done"}, {mut_op::replace, "path", "/old", "/new"}}
+  //  set         : field = value
+  //  append      : field += value
+  //  remove_part : remove the first occurrence of value from the field
+  //  replace     : replace all occurrences of value with to
+  enum class mut_op { set, append, remove_part, replace };
+
+  struct mutation {
+    mut_op op;
+    std::string field, value, to;
+  };
+
+  typedef std::vector<mutation> mutation_spec;
+
+  // bulk import, see table::import_rows
+  //  native : the table format (separator and escapes of the table metadata)
+  //  tsv    : tab separated, with \t, \n, \r and \\ escapes
+  //  csv    : RFC 4180 (comma separated, "quoted" fields may contain commas, "" and newlines)
+  enum class import_format { native, tsv, csv };
+
+  struct import_options {
+    import_format format = import_format::native;
+    // merge key: an imported row replaces the first row with equal key fields (empty = append all rows)
+    std::vector<std::string> key;
+  };
+
+  // import_error - invalid input (e.g. a wrong field count), what() names the line
+  struct import_error : public std::runtime_error {
+    using runtime_error::runtime_error;
+  };
+
   // metadata class
   class metadata final {
     struct impl;
@@ -94,6 +144,77 @@ namespace zsdatab {
   class table;
   struct table_interface;
 
+  // row_view class:
+  //  read-only view on the rows of a buffer or row store,
+  //  or on a selection (row numbers) of them
+  class row_view final {
+    const buffer_t *_buf;
+    const row_store *_store;
+    const size_t *_sel;
+    size_t _size;
+
+   public:
+    class iterator;
+
+    row_view() noexcept
+      : _buf(nullptr), _store(nullptr), _sel(nullptr), _size(0) { }
+    row_view(const buffer_t &b) noexcept
+      : _buf(&b), _store(nullptr), _sel(nullptr), _size(b.size()) { }
+    row_view(const row_store &s) noexcept
+      : _buf(nullptr), _store(&s), _sel(nullptr), _size(s.size()) { }
+    row_view(const row_store &s, const std::vector<size_t> &sel) noexcept
+      : _buf(nullptr), _store(&s), _sel(sel.data()), _size(sel.size()) { }
+
+    bool empty() const noexcept
+      { return !_size; }
+    auto size() const noexcept -> size_t
+      { return _size; }
+    auto operator[](const size_t i) const noexcept -> const row_t&
+      { return _store ? *(*_store)[index(i)] : (*_buf)[index(i)]; }
+    // row number in the underlying buffer
+    auto index(const size_t i) const noexcept -> size_t
+      { return _sel ? _sel[i] : i; }
+    // shared pointer to row i (rows of plain buffers are copied)
+    auto share(const size_t i) const -> row_ptr
+      { return _store ? (*_store)[index(i)] : std::make_shared<row_t>((*_buf)[index(i)]); }
+
+    auto begin() const noexcept -> iterator;
+    auto end() const noexcept -> iterator;
+  };
+
+  class row_view::iterator {
+    row_view _v;
+    size_t _i;
+
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef row_t value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const row_t *pointer;
+    typedef const row_t &reference;
+
+    iterator(const row_view &v, const size_t i) noexcept
+      : _v(v), _i(i) { }
+
+    auto operator*() const noexcept -> const row_t&
+      { return _v[_i]; }
+    auto operator->() const noexcept -> const row_t*
+      { return &_v[_i]; }
+    auto operator++() noexcept -> iterator&
+      { ++_i; return *this; }
+    auto operator++(int) noexcept -> iterator
+      { return iterator(_v, _i++); }
+    bool operator==(const iterator &o) const noexcept
+      { return _i == o._i; }
+    bool operator!=(const iterator &o) const noexcept
+      { return _i != o._i; }
+  };
+
+  inline auto row_view::begin() const noexcept -> iterator
+    { return iterator(*this, 0); }
+  inline auto row_view::end() const noexcept -> iterator
+    { return iterator(*this, _size); }
+
   // buffer_interface class:
   //  common interface for table, context and const_context
   //  provides an interface to a buffer and the associated metadata
@@ -103,11 +224,42 @@ namespace zsdatab {
     virtual auto get_metadata() const noexcept -> const metadata& = 0;
     virtual auto get_const_table() const noexcept -> const table_interface& = 0;
 
-    virtual auto data() const noexcept -> const buffer_t& = 0;
+    // NOTE: data() may have to copy the rows into a buffer (may throw bad_alloc)
+    virtual auto data() const -> const buffer_t& = 0;
     virtual auto data_move_out() && -> buffer_t&& = 0;
 
+    // rows() gives access to the rows without materializing a buffer
+    // (contexts may only hold a selection of the rows of their table)
+    virtual auto rows() const noexcept -> row_view
+      { return data(); }
+
     bool empty() const noexcept
-      { return data().empty(); }
+      { return rows().empty(); }
+  };
+
+  /* hw_counters - hardware event counts (Linux perf_event_open), see enable_hw_counters
+   * valid = false if the counters aren't enabled or unavailable
+   */
+  struct hw_counters {
+    bool valid = false;
+    std::uint64_t cycles = 0, instructions = 0, cache_misses = 0, branch_misses = 0;
+  };
+
+  /* io_stats - costs of loading and writing back a permanent table
+   * (all zero for other tables); cpu = CPU time of the whole process
+   * the write stages describe the last write-back
+   */
+  struct io_stats {
+    struct stage {
+      std::chrono::nanoseconds wall{0}, cpu{0};
+      // only if enable_hw_counters succeeded
+      hw_counters hw;
+    };
+
+    // load: lock_wait, read (the data file), parse
+    // write-back: serialize, write, fsync
+    stage lock_wait, read, parse, serialize, write, fsync;
+    size_t bytes_read = 0, rows_loaded = 0, bytes_written = 0;
   };
 
   struct table_clone_error : public std::runtime_error {
@@ -118,13 +270,27 @@ namespace zsdatab {
   //  common interface for tables
   struct table_interface : public buffer_interface {
     virtual bool good() const noexcept = 0;
-    virtual auto data() const noexcept -> const buffer_t& = 0;
+    virtual auto data() const -> const buffer_t& = 0;
     virtual void data(const buffer_t &n) = 0;
     virtual auto clone() const -> std::shared_ptr<table_interface> = 0;
+
+    // shared row storage, the store must not be modified while it is shared
+    virtual auto shared_rows() const -> std::shared_ptr<const row_store> = 0;
+    virtual void shared_rows(std::shared_ptr<const row_store> n) = 0;
+
+    // sync - write the rows back to the table file, if they were changed
+    // (tables without a file always succeed)
+    virtual bool sync()
+      { return true; }
+
+    virtual auto get_io_stats() const noexcept -> io_stats
+      { return {}; }
   };
 
   class const_context;
   class context;
+  class group_by;
+  class predicate;
 
   // table (delegating) class
   class table final : public table_interface {
@@ -157,7 +323,7 @@ namespace zsdatab {
     auto get_const_table() const noexcept -> const table&
       { return *this; }
 
-    auto data() const noexcept -> const buffer_t&
+    auto data() const -> const buffer_t&
       { return _t->data(); }
 
     auto data_move_out() && -> buffer_t&&
@@ -165,8 +331,38 @@ namespace zsdatab {
 
     void data(const buffer_t &n);
 
+    auto rows() const noexcept -> row_view
+      { return _t->rows(); }
+
+    auto shared_rows() const -> std::shared_ptr<const row_store>
+      { return _t->shared_rows(); }
+
+    void shared_rows(std::shared_ptr<const row_store> n);
+
     auto clone() const -> std::shared_ptr<table_interface>;
 
+    // permanent tables are written back on destruction, or earlier by sync
+    bool sync()
+      { return _t->sync(); }
+    auto get_io_stats() const noexcept -> io_stats
+      { return _t->get_io_stats(); }
+
+    /* update_where - apply muts to all rows which match pred, in one (parallel) pass
+     * the rows are changed in place (the row order is kept), unchanged rows stay shared
+     * @return : number of matching rows
+     * this function may throw an out_of_range exception if a field isn't found
+     */
+    auto update_where(const predicate &pred, const mutation_spec &muts) -> size_t;
+
+    /* import_rows - parse rows (in parallel) and append or merge them, as one change
+     * every record must have exactly one field per column, empty lines are skipped;
+     * nothing is imported if a record is invalid
+     * @return : number of imported rows
+     * this function may throw an import_error, or an out_of_range exception if a key field isn't found
+     */
+    auto import_rows(std::istream &in, const import_options &opts = {}) -> size_t;
+    auto import_rows(const std::string &data, const import_options &opts = {}) -> size_t;
+
     auto filter(const size_t field, const std::string& value, const bool whole = true, const bool neg = false) -> context;
     auto filter(const std::string& field, const std::string& value, const bool whole = true, const bool neg = false) -> context;
     auto filter(const size_t field, const std::string& value, const bool whole = true, const bool neg = false) const -> const_context;
@@ -185,18 +381,40 @@ namespace zsdatab {
   table make_gzipped_table(const std::string &_path);
 
   namespace intern {
+    // sort_column - resolved sort_key (column number instead of name)
+    struct sort_column {
+      size_t field;
+      sort_order order;
+    };
+
+    typedef std::vector<sort_column> sort_columns;
+
+    // filter_term - one condition of a fused filter (all terms must match)
+    struct filter_term {
+      size_t field;
+      std::string value;
+      bool whole, neg;
+    };
+
+    // resolve_sort_spec - map field names to column numbers
+    // this function may throw an out_of_range exception if a name isn't found
+    auto resolve_sort_spec(const metadata &meta, const sort_spec &spec) -> sort_columns;
+
     class fixcol_proxy_common {
      public:
       explicit fixcol_proxy_common(const size_t nr) : _nr(nr) { }
       fixcol_proxy_common(const buffer_interface &uplink, const std::string &field);
 
       // report
+      // _uniq = true : drop duplicate values, keeping the first occurrence
       auto get(const bool _uniq = false) const -> std::vector<std::string>;
+      // number of distinct values (the values aren't copied)
+      auto count_distinct() const -> size_t;
 
      protected:
       const size_t _nr;
 
-      virtual auto _underlying_data() const -> const buffer_t& = 0;
+      virtual auto _underlying_rows() const -> row_view = 0;
     };
 
     class context_common;
@@ -217,7 +435,7 @@ namespace zsdatab {
       fixcol_proxy& replace(const std::string &from, const std::string &to);
 
      protected:
-      auto _underlying_data() const -> const buffer_t&;
+      auto _underlying_rows() const -> row_view;
     };
 
     class const_fixcol_proxy final : public fixcol_proxy_common {
@@ -229,23 +447,28 @@ namespace zsdatab {
       const_fixcol_proxy(const fixcol_proxy &o);
 
      protected:
-      auto _underlying_data() const -> const buffer_t&
-        { return _uplink.data(); }
+      auto _underlying_rows() const -> row_view
+        { return _uplink.rows(); }
     };
 
     // base class for contexts
+    //  a context holds a selection (row numbers) of a row storage, which is usually
+    //  shared with its table; the selected rows are only copied into a private buffer
+    //  if they are changed or if data() is called
     class context_common : public buffer_interface {
       friend class fixcol_proxy;
 
      public:
-      context_common(const buffer_interface &bif) : _buffer(bif.data())   { }
-      context_common(const buffer_t &o)           : _buffer(o)            { }
-      context_common(buffer_t &&o)                : _buffer(std::move(o)) { }
+      context_common(const buffer_interface &bif);
+      context_common(const table_interface &tab);
+      context_common(const buffer_t &o);
+      context_common(buffer_t &&o);
       context_common(const context_common &ctx) = default;
       context_common(context_common &&ctx) noexcept = default;
       virtual ~context_common() noexcept = default;
 
       auto operator=(const context_common &o) -> context_common&;
+      auto operator=(const table_interface &o) -> context_common&;
       auto operator=(const buffer_interface &o) -> context_common&;
       auto operator=(context_common &&o) -> context_common&;
       auto operator+=(const buffer_interface &o) -> context_common&;
@@ -259,10 +482,28 @@ namespace zsdatab {
       // select
       context_common& clear() noexcept;
       context_common& sort();
+      context_common& sort(const sort_spec &spec);
+      context_common& stable_sort(const sort_spec &spec);
+      context_common& sort(const sort_columns &cols, const bool stable = false);
       context_common& uniq();
+      // distinct = uniq without sorting (keeps the first occurrence of every row)
+      context_common& distinct();
       context_common& negate();
       context_common& filter(const size_t field, const std::string& value, const bool whole = true, const bool neg = false);
       context_common& filter(const std::string& field, const std::string& value, const bool whole = true, const bool neg = false);
+      // filter with limit: keep the first 'limit' matches and stop scanning after them
+      context_common& filter(const size_t field, const std::string& value, const bool whole, const bool neg, const size_t limit);
+      context_common& filter(const std::string& field, const std::string& value, const bool whole, const bool neg, const size_t limit);
+      // fused filter: single pass over the buffer, the terms are evaluated
+      // in order of estimated cost/selectivity
+      context_common& filter(const std::vector<filter_term> &terms, const size_t limit = std::string::npos);
+      // predicate filter: single pass, the predicate is compiled once per call
+      context_common& filter(const predicate &pred, const size_t limit = std::string::npos);
+      // keep only the first n rows
+      context_common& limit(const size_t n);
+      // top_k = stable_sort + limit (via partial selection)
+      context_common& top_k(const sort_spec &spec, const size_t k);
+      context_common& top_k(const sort_columns &cols, const size_t k);
 
       // change
       context_common& set_field(const size_t field, const std::string& value);
@@ -274,17 +515,29 @@ namespace zsdatab {
       context_common& append_part(const std::string& field, const std::string& value);
       context_common& remove_part(const std::string& field, const std::string& value);
       context_common& replace_part(const std::string& field, const std::string& from, const std::string& to);
+      // apply muts to the selected rows which match pred (the selection is kept)
+      context_common& update_where(const predicate &pred, const mutation_spec &muts);
 
       // report
       auto get_column_data(const size_t colnr, const bool _uniq = false) const -> std::vector<std::string>;
       auto get_column_data(const std::string &colname, const bool _uniq = false) const -> std::vector<std::string>;
+      auto group_by(const row_t &cols) const -> zsdatab::group_by;
+      // count, exists, count_distinct don't change the selection and don't copy any rows
+      auto count() const noexcept -> size_t
+        { return rows().size(); }
+      auto count(const predicate &pred) const -> size_t;
+      bool exists() const noexcept
+        { return !empty(); }
+      // exists(pred) stops at the first match
+      bool exists(const predicate &pred) const;
+      auto count_distinct(const std::string &field) const -> size_t;
 
       auto get_metadata() const noexcept -> const metadata&
         { return get_const_table().get_metadata(); }
-      auto data() const noexcept -> const buffer_t&
-        { return _buffer; }
-      auto data_move_out() && -> buffer_t&&
-        { return std::move(_buffer); }
+      // NOTE: data() copies the selected rows into a buffer (cached until the context is changed)
+      auto data() const -> const buffer_t&;
+      auto data_move_out() && -> buffer_t&&;
+      auto rows() const noexcept -> row_view;
 
       auto get_field_nr(const std::string &colname) const -> size_t;
 
@@ -292,7 +545,29 @@ namespace zsdatab {
       virtual auto get_const_table() const noexcept -> const table_interface& = 0;
 
      protected:
-      buffer_t _buffer;
+      // row storage, _sel holds distinct row numbers in _base
+      // (_sel_all = true: all rows of _base are selected, in order)
+      mutable std::shared_ptr<const row_store> _base;
+      mutable std::vector<size_t> _sel;
+      mutable bool _sel_all;
+
+      // buffer returned by data(), built from _cache_src
+      mutable std::shared_ptr<buffer_t> _cache;
+      mutable std::weak_ptr<const row_store> _cache_src;
+
+      // get the (explicit) selection
+      auto sel() -> std::vector<size_t>&;
+      // select rows by their position in the current selection
+      void select_positions(const std::vector<size_t> &pos);
+      // make _base contain exactly the selected rows
+      auto materialize() const -> const std::shared_ptr<const row_store>&;
+      // make _base a private store of the selected rows, which can be modified
+      // (the rows itself are still shared, use mutable_row to change them)
+      auto own() -> row_store&;
+      void swap_rows(context_common &o) noexcept;
+
+      // copy on write for a single row
+      static auto mutable_row(row_ptr &p) -> row_t&;
 
       fixcol_proxy get_fixcol_proxy(const size_t field);
     };
@@ -315,6 +590,9 @@ namespace zsdatab {
       context_base(T &tab, buffer_t &&o)
         : context_common(std::move(o)), _table(tab) { }
 
+      context_base(T &tab, const context_common &o)
+        : context_common(o), _table(tab) { }
+
       context_base(const T &&tab) = delete;
       context_base(const T &&tab, const buffer_t &&o) = delete;
 
@@ -375,9 +653,16 @@ namespace zsdatab {
 
     // transfer
     void push()
-      { _table.data(_buffer); }
+      { _table.shared_rows(materialize()); }
     void swap(context &o) noexcept
-      { _buffer.swap(o._buffer); }
+      { swap_rows(o); }
+
+    /* update - apply muts to the selected rows and write them back into the table,
+     * in place if the context was selected from the current table rows (otherwise
+     * the changed rows are moved to the end of the table, like negate + push)
+     * the changed rows stay selected
+     */
+    context& update(const mutation_spec &muts);
 
     // rm = negate push
     // rmexcept = push
@@ -397,19 +682,28 @@ namespace zsdatab {
     // select
     transaction& clear();
     transaction& sort();
+    transaction& sort(const sort_spec &spec);
+    transaction& stable_sort(const sort_spec &spec);
     transaction& uniq();
+    transaction& distinct();
     transaction& negate();
     transaction& filter(const std::string& field, const std::string& value, const bool whole = true);
+    transaction& filter(const predicate &pred);
+    transaction& limit(const size_t n);
+    transaction& top_k(const sort_spec &spec, const size_t k);
 
     // change
     transaction& set_field(const std::string& field, const std::string& value);
     transaction& append_part(const std::string& field, const std::string& value);
     transaction& remove_part(const std::string& field, const std::string& value);
     transaction& replace_part(const std::string& field, const std::string& from, const std::string& to);
+    transaction& update_where(const predicate &pred, const mutation_spec &muts);
 
    private:
     const metadata _meta;
     std::vector<std::shared_ptr<intern::ta::action>> _actions;
+
+    transaction& add_filter(std::shared_ptr<intern::ta::action> &&p);
   };
 
   /* inner_join - join to buffers into a table via inner join (common subset)
@@ -425,4 +719,205 @@ namespace zsdatab {
 
   // table_map_fields - map field names (mappings: {from, to}) (e.g. for an following join)
   table table_map_fields(const buffer_interface &in, std::unordered_map<std::string, std::string> mappings);
+
+  // aggregate functions for group_by
+  //  count          : number of rows in the group (field is ignored)
+  //  min, max       : smallest/greatest value (string order, like sort)
+  //  sum            : sum of the numeric values (plain decimal numbers like -1.5e3,
+  //                   other values, e.g. ' 1', '0x10', 'nan', count as 0)
+  //  count_distinct : number of distinct values
+  enum class agg { count, min, max, sum, count_distinct };
+
+  struct aggregate {
+    agg fn;
+    std::string field;
+  };
+
+  typedef std::vector<aggregate> aggregate_spec;
+
+  /* group_by - hash aggregation over a buffer
+   * usage: group_by(ctx, {"status"}).agg({{agg::count, {}}, {agg::max, "date"}})
+   *
+   * agg() returns an in-memory table with the group columns followed by one column
+   * per aggregate (named "count" or "FN(FIELD)"), groups are in order of first occurrence
+   *
+   * NOTE: the buffer must stay alive and unchanged while the group_by object is used
+   */
+  class group_by final {
+   public:
+    // this function may throw an out_of_range exception if a name isn't found
+    group_by(const buffer_interface &src, const row_t &cols);
+
+    auto agg(const aggregate_spec &aggs) const -> table;
+
+   private:
+    const buffer_interface &_src;
+    std::vector<size_t> _cols;
+  };
+
+  /* predicate - filter condition for contexts and transactions
+   * usage: ctx.filter(predicate::equals("a", "x") && !predicate::compare("b", predicate::LT, 5))
+   *    or: ctx.filter(predicate::parse("a = x and not b < 5"))
+   *
+   * predicates are compiled against the metadata into a flat program, which is
+   * evaluated in a single pass over the buffer (cheap tests of and/or first)
+   *
+   * parse syntax (FIELD and VALUE are words or quoted strings):
+   *   FIELD = VALUE           whole field matches
+   *   FIELD != VALUE          whole field doesn't match
+   *   FIELD ~ VALUE           field contains VALUE
+   *   FIELD ^= VALUE          field starts with VALUE
+   *   FIELD =~ REGEX          field contains a match of REGEX (ECMAScript)
+   *   FIELD < <= > >= == <> NUM  numeric comparison (fields which aren't numbers never match)
+   *                           NUM and numbers in fields are plain decimals like -1.5e3
+   *                           (no whitespace, hex, inf or nan)
+   *   not X, X and Y, X or Y, (X), also !, &&, ||
+   */
+  class predicate final {
+   public:
+    struct node;
+
+    enum cmp_op { LT, LE, GT, GE, EQ, NE };
+
+    explicit predicate(std::shared_ptr<const node> n) noexcept
+      : _n(std::move(n)) { }
+
+    static auto equals(const std::string &field, const std::string &value) -> predicate;
+    static auto contains(const std::string &field, const std::string &value) -> predicate;
+    static auto prefix(const std::string &field, const std::string &value) -> predicate;
+    // this function may throw a std::regex_error exception
+    static auto regex(const std::string &field, const std::string &pattern) -> predicate;
+    static auto compare(const std::string &field, const cmp_op op, const double value) -> predicate;
+
+    // this function may throw an invalid_argument exception (syntax error)
+    static auto parse(const std::string &expr) -> predicate;
+
+    auto operator&&(const predicate &o) const -> predicate;
+    auto operator||(const predicate &o) const -> predicate;
+    auto operator!() const -> predicate;
+
+    // names of all fields used in the predicate
+    auto fields() const -> row_t;
+    auto to_string() const -> std::string;
+
+    auto get_node() const noexcept -> const std::shared_ptr<const node>&
+      { return _n; }
+
+   private:
+    std::shared_ptr<const node> _n;
+  };
+
+  /* executor - runs the parallel parts of library operations
+   * the default executor is an internal work-stealing scheduler with
+   *   $ZSDATAB_THREADS threads, or one thread per CPU in the affinity mask of the process
+   * (the calling thread counts as one of them)
+   */
+  struct executor {
+    virtual ~executor() noexcept = default;
+
+    // number of threads which may run tasks at once (including the calling thread)
+    //  read once while the executor is installed
+    virtual auto concurrency() const noexcept -> size_t = 0;
+
+    // run - call fn(i) for every i in [0, n) and return after all calls are finished
+    //  fn doesn't throw, and the calls may run on any thread (including the calling one)
+    virtual void run(const size_t n, const std::function<void (size_t)> &fn) = 0;
+  };
+
+  // use ex for all parallel operations (nullptr = internal scheduler)
+  void set_executor(std::shared_ptr<executor> ex);
+  auto get_executor() -> std::shared_ptr<executor>;
+
+  // thread count of the internal scheduler (0 = default, 1 = everything runs sequentially)
+  // NOTE: don't call set_thread_count while any library operation is running
+  void set_thread_count(const size_t n);
+  auto get_thread_count() -> size_t;
+
+  /* parallel dispatch - every parallel operation (filter, negate, uniq, distinct,
+   * sort, group_by, fixcol, update, import, serialize) runs sequentially unless its estimated sequential time
+   * (input size * calibrated cost per element) outweighs the scheduling overhead;
+   * $ZSDATAB_PAR_THRESHOLD (N or OP=N[,OP=N]...) sets fixed thresholds
+   */
+  struct parallel_stats {
+    std::string op;
+    // estimated cost per element (calibrated on sequential runs)
+    double cost_ns;
+    // inputs with at least this many elements run in parallel (npos = never)
+    size_t threshold;
+    // threshold set via set_parallel_threshold or the environment
+    bool overridden;
+    size_t seq_runs, par_runs;
+  };
+
+  auto get_parallel_stats() -> std::vector<parallel_stats>;
+
+  // set_parallel_threshold - run op in parallel from n elements on (0 = use the cost model)
+  // this function may throw an out_of_range exception if op isn't known
+  void set_parallel_threshold(const std::string &op, const size_t n);
+
+  /* instrumentation - costs of library operations for the host program
+   * the counters are always collected (a few relaxed atomic adds per operation),
+   * events are only delivered if a sink is installed
+   */
+  enum class event_type {
+    table_open, // a permanent table was locked and loaded (duration = lock wait)
+    parse,      // rows were parsed (load, import)
+    filter,     // context filter
+    sort,       // context sort, top_k
+    join,       // inner_join
+    write_back  // a permanent table was serialized, written and synced
+  };
+
+  struct event {
+    event_type type;
+    std::chrono::nanoseconds duration;
+    // rows_in: filter, sort; rows_out: all but write_back
+    // bytes: table_open (read), parse, write_back (written)
+    size_t rows_in, rows_out, bytes;
+  };
+
+  struct event_sink {
+    virtual ~event_sink() noexcept = default;
+
+    // on_event - called by the thread which ran the operation (possibly concurrently)
+    virtual void on_event(const event &ev) noexcept = 0;
+  };
+
+  // send all events to sink (nullptr = no sink)
+  void set_event_sink(std::shared_ptr<event_sink> sink);
+  auto get_event_sink() -> std::shared_ptr<event_sink>;
+
+  // counters - totals since the start (or the last reset_counters), times in nanoseconds
+  struct counters {
+    std::uint64_t table_opens, lock_wait_ns, rows_loaded;
+    std::uint64_t parses, bytes_parsed, parse_ns;
+    std::uint64_t filters, filter_ns, sorts, sort_ns, joins, join_ns;
+    std::uint64_t write_backs, bytes_written, write_back_ns;
+  };
+
+  auto get_counters() noexcept -> counters;
+  void reset_counters() noexcept;
+
+  /* enable_hw_counters - count cycles, instructions, cache and branch misses of the
+   * calling thread (added on every call) and of the threads of the internal scheduler
+   * (threads of a custom executor aren't counted); io_stats stages get the counts, too
+   * @return : false if the counters are unavailable (not Linux, perf_event_paranoid,
+   *          no PMU (e.g. in VMs), seccomp)
+   */
+  bool enable_hw_counters() noexcept;
+
+  // read_hw_counters - totals of all counted threads (exited ones, too) since they were added
+  auto read_hw_counters() noexcept -> hw_counters;
+
+  /* start_trace - record spans of all threads (table lock, read, parse, filter, sort, join,
+   * transaction actions, scheduler tasks, parallel chunks, write-back) and the busy
+   * scheduler threads until stop_trace; $ZSDATAB_TRACE=FILE traces the whole process
+   * @return : false if a trace is already running
+   */
+  bool start_trace(const std::string &path);
+
+  /* stop_trace - write the trace as Chrome trace event JSON (chrome://tracing, ui.perfetto.dev)
+   * @return : false if no trace is running or the file couldn't be written
+   */
+  bool stop_trace();
 }